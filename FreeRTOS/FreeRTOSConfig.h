@@ -18,7 +18,7 @@
 #define configIDLE_SHOULD_YIELD                 1
 #define configUSE_TASK_NOTIFICATIONS            1
 #define configTASK_NOTIFICATION_ARRAY_ENTRIES   3
-#define configUSE_MUTEXES                       0
+#define configUSE_MUTEXES                       1
 #define configUSE_RECURSIVE_MUTEXES             0
 #define configUSE_COUNTING_SEMAPHORES           0
 #define configQUEUE_REGISTRY_SIZE               10
@@ -44,7 +44,7 @@
 
 /* Run time and task stats gathering related definitions. */
 #define configGENERATE_RUN_TIME_STATS           0
-#define configUSE_TRACE_FACILITY                0
+#define configUSE_TRACE_FACILITY                1
 #define configUSE_STATS_FORMATTING_FUNCTIONS    0
 
 /* Co-routine related definitions. */
@@ -81,4 +81,28 @@
 
 /* A header file that defines trace macro can be included here. */
 
+/* Trace recorder (ProjectFiles/trace.c). Records task switches and blocking
+into a RAM ring buffer. Set to 0 to compile the hooks out. */
+#define configUSE_TRACE_RECORDER                1
+
+#if configUSE_TRACE_RECORDER && !defined(__ASSEMBLER__)
+    #include <stdint.h>
+
+    void trace_task_create( uint32_t task, const char * name );
+    void trace_task_switched_in( uint32_t task );
+    void trace_task_switched_out( uint32_t task );
+    void trace_task_delay( void );
+    void trace_blocking_on_queue( int sending );
+
+    /* uxTCBNumber is filled in just before traceTASK_CREATE when
+    configUSE_TRACE_FACILITY is 1 */
+    #define traceTASK_CREATE( pxNewTCB )            trace_task_create( ( pxNewTCB )->uxTCBNumber, ( pxNewTCB )->pcTaskName )
+    #define traceTASK_SWITCHED_IN()                 trace_task_switched_in( pxCurrentTCB->uxTCBNumber )
+    #define traceTASK_SWITCHED_OUT()                trace_task_switched_out( pxCurrentTCB->uxTCBNumber )
+    #define traceTASK_DELAY()                       trace_task_delay()
+    #define traceTASK_DELAY_UNTIL( xTimeToWake )    trace_task_delay()
+    #define traceBLOCKING_ON_QUEUE_RECEIVE( pxQueue )   trace_blocking_on_queue( 0 )
+    #define traceBLOCKING_ON_QUEUE_SEND( pxQueue )      trace_blocking_on_queue( 1 )
+#endif
+
 #endif /* FREERTOS_CONFIG_H */
@@ -0,0 +1,328 @@
+// Checks the running totals in accounting.h against working them out again
+// from scratch over a long simulated trace, and the fixed point dew point
+// and heat index against the floating point formulas.
+//
+//   accounting_check [-d days] [-r seed]
+//
+// The trace is a thermostat heating a simulated room (see plant.h), with the
+// relay tick wandering between 0.9 and 1.1 s, the setting and humidity
+// changing now and then, and the odd sample missed for over an hour. There's
+// no reading for the first few seconds, like after a reset, and now and then
+// the sensor goes bad for a while. The 32 bit ms clock wraps halfway
+// through, however many days it runs for. At several points the
+// accounting is compared with a brute force pass over everything so far, and
+// the exit code is 1 if anything is different.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "aht20.h"
+#include "thermostat.h"
+#include "accounting.h"
+#include "plant.h"
+
+
+#define DEFAULT_DAYS 30
+#define DEFAULT_SEED 1
+#define CHECKPOINTS 8
+#define GAP_CHANCE 0.000005         // per tick, about one every couple of days
+#define SETTING_CHANCE (1 / 7200.0) // per tick
+#define FIRST_READING 5000          // ms. THERMOSTAT_NO_READING until then
+#define BAD_CHANCE 0.00001          // per tick, the sensor reads nonsense for up to half an hour
+#define BAD_TEMPERATURE 3020        // 150C, a frame of all ones
+#define BAD_HUMIDITY 100
+#define FORMULA_TOLERANCE 5         // 10ths of a degree
+
+
+struct sample {
+    uint64_t time;      // ms, doesn't wrap
+    int16_t temperature;
+    int16_t setting;
+    uint8_t humidity;
+    bool relay_on;
+};
+
+struct totals {
+    uint64_t runtime;
+    uint32_t cycles;
+    int hour_duty;
+    int day_duty;
+    uint32_t degree_minutes;
+    int dew_point;
+    int heat_index;
+};
+
+
+static struct sample* trace;
+static long trace_count;
+static long bad_count;
+
+
+
+/*****************************************************/
+/****************** Trace ****************************/
+/*****************************************************/
+
+// so the 32 bit clock wraps halfway through. It only wraps every 49.7
+// days, so longer runs start at 0 instead
+static uint64_t start_time(int days){
+    uint64_t half = (uint64_t)days * 12 * ACCOUNTING_MS_PER_HOUR;
+    return half < 0x100000000ull ? 0x100000000ull - half : 0;
+}
+
+
+// what the relay task sees every tick, with a reading every SENSE_INTERVAL
+static void make_trace(int days, uint64_t seed){
+    uint64_t random = seed;
+    struct plant p;
+    plant_random_room(&p, &random);
+
+    long capacity = (long)days * 24 * 4000 + 1;     // ticks are at least 0.9 s
+    trace = malloc(capacity * sizeof(struct sample));
+    if(!trace){ perror("malloc"); exit(2); }
+
+    struct thermostat t;
+    plant_thermostat_initialize(&t, 680);
+
+    uint64_t now = start_time(days);
+    uint64_t end = now + (uint64_t)days * 24 * ACCOUNTING_MS_PER_HOUR;
+    uint64_t next_reading = now + FIRST_READING;
+    uint64_t bad_until = 0;
+    while(now < end && trace_count < capacity){
+        if(now >= next_reading){
+            plant_sense(&p, &t);
+            next_reading += SENSE_INTERVAL;
+        }
+        if(plant_random_between(&random, 0, 1) < SETTING_CHANCE)
+            thermostat_set_setting(&t, 600 + (int)plant_random_between(&random, 0, 15) * 10);
+
+        int relay = thermostat_update_relay(&t);
+        struct sample* s = &trace[trace_count++];
+        s->time = now;
+        s->temperature = thermostat_get_temperature(&t);
+        s->setting = thermostat_get_setting(&t);
+        s->humidity = thermostat_get_humidity(&t);
+        s->relay_on = relay == ON;
+
+        // the thermostat carries on, but what accounting is given is junk
+        if(plant_random_between(&random, 0, 1) < BAD_CHANCE)
+            bad_until = now + plant_random_between(&random, 1, 30) * 60000;
+        if(now < bad_until){
+            s->temperature = BAD_TEMPERATURE;
+            s->humidity = BAD_HUMIDITY;
+        }
+        if(!AHT20_VALID_TEMPERATURE(s->temperature)) bad_count++;
+
+        uint32_t tick = plant_random_between(&random, 900, 1100);
+        if(plant_random_between(&random, 0, 1) < GAP_CHANCE)
+            tick = plant_random_between(&random, 1, 3) * ACCOUNTING_MS_PER_HOUR;
+        plant_step(&p, relay == ON, tick / 1000.0);
+        p.humidity += plant_random_between(&random, -0.05, 0.05);
+        if(p.humidity < 5) p.humidity = 5;
+        if(p.humidity > 95) p.humidity = 95;
+        now += tick;
+    }
+}
+
+
+
+/*****************************************************/
+/****************** Offline **************************/
+/*****************************************************/
+
+// on time in [from, to), from the samples before last
+static uint64_t on_between(long last, uint64_t from, uint64_t to){
+    uint64_t on = 0;
+    for(long i=0; i<last; i++){
+        if(!trace[i].relay_on) continue;
+        uint64_t start = trace[i].time > from ? trace[i].time : from;
+        uint64_t stop = trace[i+1].time < to ? trace[i+1].time : to;
+        if(stop > start) on += stop - start;
+    }
+    return on;
+}
+
+
+// everything up to and including sample last, the long way round
+static struct totals offline(long last){
+    struct totals t = {0};
+    uint64_t outside = 0;
+
+    for(long i=0; i<=last; i++){
+        const struct sample* s = &trace[i];
+        if(!AHT20_VALID_TEMPERATURE(s->temperature)) continue;
+        t.dew_point = accounting_dew_point(s->temperature, s->humidity);
+        t.heat_index = accounting_heat_index(s->temperature, s->humidity);
+    }
+
+    for(long i=0; i<last; i++){
+        const struct sample* s = &trace[i];
+        uint64_t elapsed = trace[i+1].time - s->time;
+        if(s->relay_on) t.runtime += elapsed;
+        if(trace[i+1].relay_on && !s->relay_on) t.cycles++;
+        if(!AHT20_VALID_TEMPERATURE(s->temperature)) continue;
+
+        int low = s->setting - ACCOUNTING_COMFORT_BAND;
+        int high = s->setting + TEMP_THRESHOLD + ACCOUNTING_COMFORT_BAND;
+        int away = s->temperature < low ? low - s->temperature
+                 : s->temperature > high ? s->temperature - high : 0;
+        outside += (uint64_t)away * elapsed;
+    }
+    t.degree_minutes = outside / 60000;
+
+    uint64_t hour = ACCOUNTING_MS_PER_HOUR;
+    uint64_t hours = (trace[last].time - trace[0].time) / hour;
+    if(hours > 0){
+        uint64_t end = trace[0].time + hours * hour;
+        uint64_t day_hours = hours < ACCOUNTING_HOURS ? hours : ACCOUNTING_HOURS;
+        t.hour_duty = on_between(last, end - hour, end) * 1000 / hour;
+        t.day_duty = on_between(last, end - day_hours * hour, end) * 1000 / (day_hours * hour);
+    }
+    return t;
+}
+
+
+static struct totals online(const struct accounting* a){
+    struct totals t;
+    t.runtime = a->runtime;
+    t.cycles = a->cycles;
+    t.hour_duty = accounting_hour_duty(a);
+    t.day_duty = accounting_day_duty(a);
+    t.degree_minutes = accounting_degree_minutes(a);
+    t.dew_point = a->dew_point;
+    t.heat_index = a->heat_index;
+    return t;
+}
+
+
+static int compare(long last, const struct accounting* a){
+    struct totals want = offline(last);
+    struct totals got = online(a);
+    bool same = memcmp(&want, &got, sizeof(want)) == 0;
+
+    printf("%7.2f days: runtime %8.2f h, %6lu cycles, duty %5.1f%% hour %5.1f%% day, %9.1f deg-min, "
+           "dew %5.1f, index %5.1f  %s\n",
+            (trace[last].time - trace[0].time) / (24 * 3.6e6), got.runtime / 3.6e6,
+            (unsigned long)got.cycles, got.hour_duty / 10.0, got.day_duty / 10.0,
+            got.degree_minutes / 10.0, got.dew_point / 10.0, got.heat_index / 10.0,
+            same ? "ok" : "DIFFERENT");
+    if(!same){
+        printf("  expected runtime %8.2f h, %6lu cycles, duty %5.1f%% hour %5.1f%% day, %9.1f deg-min, "
+               "dew %5.1f, index %5.1f\n",
+                want.runtime / 3.6e6, (unsigned long)want.cycles, want.hour_duty / 10.0,
+                want.day_duty / 10.0, want.degree_minutes / 10.0,
+                want.dew_point / 10.0, want.heat_index / 10.0);
+    }
+    return !same;
+}
+
+
+
+/*****************************************************/
+/****************** Formulas *************************/
+/*****************************************************/
+
+static double dew_point(double f, double rh){
+    double c = (f - 32) * 5 / 9;
+    double gamma = log(rh / 100) + 17.62 * c / (243.12 + c);
+    return 243.12 * gamma / (17.62 - gamma) * 9 / 5 + 32;
+}
+
+static double heat_index(double t, double rh){
+    double simple = 0.5 * (t + 61.0 + (t - 68.0) * 1.2 + rh * 0.094);
+    if((simple + t) / 2 < 80) return simple;
+
+    double index = -42.379 + 2.04901523*t + 10.14333127*rh - 0.22475541*t*rh
+                 - 0.00683783*t*t - 0.05481717*rh*rh + 0.00122874*t*t*rh
+                 + 0.00085282*t*rh*rh - 0.00000199*t*t*rh*rh;
+    if(rh < 13 && t >= 80 && t <= 112)
+        index -= (13 - rh) / 4 * sqrt((17 - fabs(t - 95)) / 17);
+    else if(rh > 85 && t >= 80 && t <= 87)
+        index += (rh - 85) / 10 * (87 - t) / 5;
+    return index;
+}
+
+
+// every 10th of a degree from 30 to 110F at every whole humidity.
+// returns how many are out by more than FORMULA_TOLERANCE
+static int check_formulas(){
+    double worst_dew = 0, worst_index = 0;
+    int worst_dew_t = 0, worst_dew_rh = 0, worst_index_t = 0, worst_index_rh = 0;
+    int failures = 0;
+
+    for(int t=300; t<=1100; t++){
+        for(int rh=1; rh<=100; rh++){
+            double dew = fabs(accounting_dew_point(t, rh) - dew_point(t / 10.0, rh) * 10);
+            double index = fabs(accounting_heat_index(t, rh) - heat_index(t / 10.0, rh) * 10);
+            if(dew > worst_dew){ worst_dew = dew; worst_dew_t = t; worst_dew_rh = rh; }
+            if(index > worst_index){ worst_index = index; worst_index_t = t; worst_index_rh = rh; }
+            failures += dew > FORMULA_TOLERANCE;
+            failures += index > FORMULA_TOLERANCE;
+        }
+    }
+    printf("dew point worst error %.2fF at %.1fF %d%%, heat index worst error %.2fF at %.1fF %d%%\n",
+            worst_dew / 10, worst_dew_t / 10.0, worst_dew_rh,
+            worst_index / 10, worst_index_t / 10.0, worst_index_rh);
+    return failures;
+}
+
+
+
+int main(int argc, char** argv){
+
+    int days = DEFAULT_DAYS;
+    uint64_t seed = DEFAULT_SEED;
+
+    for(int i=1; i<argc; i++){
+        if(i+1 >= argc){
+            fprintf(stderr, "usage: %s [-d days] [-r seed]\n", argv[0]);
+            return 2;
+        }
+        if(strcmp(argv[i], "-d") == 0) days = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-r") == 0) seed = strtoull(argv[++i], NULL, 10);
+        else { fprintf(stderr, "unknown option %s\n", argv[i]); return 2; }
+    }
+    if(days < 1){
+        fprintf(stderr, "need at least one day\n");
+        return 2;
+    }
+
+    make_trace(days, seed);
+    printf("%ld samples (%ld with a bad reading) over %d days, struct accounting is %zu bytes\n",
+            trace_count, bad_count, days, sizeof(struct accounting));
+
+    // the timing pass on its own, so the checks don't get in the way
+    struct accounting a;
+    struct timespec start, end;
+    accounting_initialize(&a);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(long i=0; i<trace_count; i++){
+        const struct sample* s = &trace[i];
+        accounting_sample(&a, (uint32_t)s->time, s->temperature, s->humidity,
+                          s->setting, TEMP_THRESHOLD, s->relay_on);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("%.1f ns per sample\n", ns / trace_count);
+
+    int failures = 0;
+    accounting_initialize(&a);
+    int checkpoint = 1;
+    for(long i=0; i<trace_count; i++){
+        const struct sample* s = &trace[i];
+        accounting_sample(&a, (uint32_t)s->time, s->temperature, s->humidity,
+                          s->setting, TEMP_THRESHOLD, s->relay_on);
+        if(i == trace_count * checkpoint / CHECKPOINTS - 1){
+            failures += compare(i, &a);
+            checkpoint++;
+        }
+    }
+
+    int formula_failures = check_formulas();
+    if(formula_failures) printf("%d dew point or heat index values out by more than %.1fF\n",
+                                formula_failures, FORMULA_TOLERANCE / 10.0);
+
+    return failures || formula_failures ? 1 : 0;
+}
@@ -0,0 +1,359 @@
+// Benchmarks for the firmware logic, run on a PC.
+//
+//   thermostat_bench [-o results.json] [-b baseline.json] [-t percent]
+//
+// Prints the results as JSON. Cycle and instruction counts come from the
+// linux perf counters when they're available (they're null otherwise, e.g.
+// in a container or with perf_event_paranoid too high). Instruction counts
+// are the thing to compare between commits, since they don't change with
+// cpu frequency or whatever else the machine is doing.
+//
+// With -b the results are compared against an earlier run, and the exit
+// code is 1 if anything's instruction count went up more than -t percent
+// (default 10). Without perf counters there's only time, which moves by
+// more than that from one run to the next on the same binary, so it's
+// printed but never fails - and it says so, since then nothing's checked.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "aht20.h"
+#include "circular_buffer.h"
+#include "i2c_module.h"
+#include "seven_seg.h"
+#include "thermostat.h"
+#include "ui.h"
+#include "host_i2c.h"
+
+
+#define ITERATIONS 100000
+#define REPEATS 7
+#define MAX_BENCHMARKS 16
+#define NAME_LENGTH 32
+#define LINE_LENGTH 256
+#define DEFAULT_THRESHOLD 10.0
+
+
+struct result {
+    char name[NAME_LENGTH];
+    double ns;
+    double cycles;          // < 0 if not counted
+    double instructions;    // < 0 if not counted
+};
+
+struct benchmark {
+    const char* name;
+    void (*setup)();
+    void (*run)(int i);
+};
+
+
+static int perf_group = -1;
+static int perf_instructions = -1;
+static volatile int sink;
+static struct thermostat thermostat;
+
+
+
+/*****************************************************/
+/****************** Perf counters ********************/
+/*****************************************************/
+
+static int perf_open(uint64_t config, int group){
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void perf_initialize(){
+    perf_group = perf_open(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if(perf_group < 0) return;
+    perf_instructions = perf_open(PERF_COUNT_HW_INSTRUCTIONS, perf_group);
+    if(perf_instructions < 0){
+        close(perf_group);
+        perf_group = -1;
+    }
+}
+
+static void perf_start(){
+    if(perf_group < 0) return;
+    ioctl(perf_group, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(perf_group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+// cycles and instructions since perf_start(). false if not available
+static bool perf_stop(uint64_t* cycles, uint64_t* instructions){
+    if(perf_group < 0) return false;
+    ioctl(perf_group, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    uint64_t values[3];     // count, then one value per counter
+    if(read(perf_group, values, sizeof(values)) != sizeof(values)) return false;
+    *cycles = values[1];
+    *instructions = values[2];
+    return true;
+}
+
+static double now_ns(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+
+
+/*****************************************************/
+/****************** Benchmarks ***********************/
+/*****************************************************/
+
+// a few raw frames from around room temperature, so every iteration isn't
+// converting the same numbers
+#define FRAME_COUNT 4
+static const uint8_t frames[FRAME_COUNT][AHT20_FRAME_LENGTH] = {
+    {0x1c, 0x66, 0x66, 0x65, 0xd0, 0x9e},
+    {0x1c, 0x6b, 0x85, 0x15, 0xe1, 0x22},
+    {0x1c, 0x70, 0xa3, 0xd5, 0xf0, 0x5a},
+    {0x1c, 0x75, 0xc2, 0x86, 0x01, 0xc8},
+};
+
+
+static void setup_firmware(){
+    i2c_module_initialize();
+    thermostat_initialize(&thermostat, 700);
+    seven_seg_begin(&thermostat.display);
+    aht20_initialize(&thermostat.sensor);
+}
+
+static void run_aht20_convert(int i){
+    host_i2c_set_aht20_frame(frames[i % FRAME_COUNT]);
+    aht20_read_measurement(&thermostat.sensor);
+    sink = aht20_get_temp(&thermostat.sensor) + aht20_get_humidity(&thermostat.sensor);
+}
+
+static void run_buffer_stats(int i){
+    buffer_append(&thermostat.samples, 680 + (i & 63));
+    sink = buffer_get_avg(&thermostat.samples);
+}
+
+static void run_seven_seg_temp(int i){
+    seven_seg_display_temp(&thermostat.display, 650 + (i & 255));
+}
+
+static void run_seven_seg_humidity(int i){
+    seven_seg_display_humidity(&thermostat.display, 1 + (i % 99));
+}
+
+// building and sending the aht20 measurement command
+static void run_i2c_framing(int i){
+    (void)i;
+    aht20_start_measurement(&thermostat.sensor);
+}
+
+// a cycle button press through the ui state table, then drawing it
+static void run_ui_event(int i){
+    struct ui_message message = {UI_EVENT_CYCLE, i};
+    struct display_request request;
+    ui_handle_event(&thermostat, &message, &request);
+    ui_show(&thermostat.display, &request);
+}
+
+// one pass of the sensor, ui, display and relay tasks, like they go on the
+// pico after each reading
+static void run_control_loop(int i){
+    struct ui_message message = {UI_EVENT_SAMPLE, i};
+    struct display_request request;
+
+    host_i2c_set_aht20_frame(frames[i % FRAME_COUNT]);
+    aht20_start_measurement(&thermostat.sensor);
+    aht20_read_measurement(&thermostat.sensor);
+    thermostat_new_reading(&thermostat);
+    ui_handle_event(&thermostat, &message, &request);
+    ui_show(&thermostat.display, &request);
+    sink = thermostat_update_relay(&thermostat);
+}
+
+
+static const struct benchmark benchmarks[] = {
+    {"aht20_convert",       setup_firmware, run_aht20_convert},
+    {"buffer_stats",        setup_firmware, run_buffer_stats},
+    {"seven_seg_temp",      setup_firmware, run_seven_seg_temp},
+    {"seven_seg_humidity",  setup_firmware, run_seven_seg_humidity},
+    {"i2c_framing",         setup_firmware, run_i2c_framing},
+    {"ui_event",            setup_firmware, run_ui_event},
+    {"control_loop",        setup_firmware, run_control_loop},
+};
+#define BENCHMARK_COUNT ((int)(sizeof(benchmarks) / sizeof(benchmarks[0])))
+
+
+// best of REPEATS runs, so noise from the rest of the machine mostly drops out
+static void run_benchmark(const struct benchmark* b, struct result* r){
+    strncpy(r->name, b->name, NAME_LENGTH - 1);
+    r->name[NAME_LENGTH - 1] = 0;
+    r->ns = r->cycles = r->instructions = -1;
+
+    b->setup();
+    for(int i=0; i<ITERATIONS; i++) b->run(i);   // warm up
+
+    for(int repeat=0; repeat<REPEATS; repeat++){
+        uint64_t cycles, instructions;
+        double start = now_ns();
+        perf_start();
+        for(int i=0; i<ITERATIONS; i++) b->run(i);
+        bool counted = perf_stop(&cycles, &instructions);
+        double ns = (now_ns() - start) / ITERATIONS;
+
+        if(r->ns < 0 || ns < r->ns) r->ns = ns;
+        if(counted){
+            double c = (double)cycles / ITERATIONS;
+            double n = (double)instructions / ITERATIONS;
+            if(r->cycles < 0 || c < r->cycles) r->cycles = c;
+            if(r->instructions < 0 || n < r->instructions) r->instructions = n;
+        }
+    }
+}
+
+
+
+/*****************************************************/
+/****************** Results **************************/
+/*****************************************************/
+
+static void print_number(FILE* f, double value){
+    if(value < 0) fprintf(f, "null");
+    else fprintf(f, "%.2f", value);
+}
+
+// one benchmark per line, so read_results() doesn't need a real json parser
+static void write_results(FILE* f, const struct result* results, int count){
+    fprintf(f, "{\n  \"iterations\": %d,\n  \"benchmarks\": [\n", ITERATIONS);
+    for(int i=0; i<count; i++){
+        fprintf(f, "    {\"name\": \"%s\", \"ns_per_iter\": ", results[i].name);
+        print_number(f, results[i].ns);
+        fprintf(f, ", \"cycles_per_iter\": ");
+        print_number(f, results[i].cycles);
+        fprintf(f, ", \"instructions_per_iter\": ");
+        print_number(f, results[i].instructions);
+        fprintf(f, "}%s\n", i+1 < count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+static double read_number(const char* line, const char* key){
+    const char* p = strstr(line, key);
+    if(!p) return -1;
+    p += strlen(key);
+    while(*p == '"' || *p == ':' || *p == ' ') p++;
+    if(strncmp(p, "null", 4) == 0) return -1;
+    return atof(p);
+}
+
+static int read_results(const char* path, struct result* results){
+    FILE* f = fopen(path, "r");
+    if(!f){ perror(path); return -1; }
+
+    int count = 0;
+    char line[LINE_LENGTH];
+    while(fgets(line, sizeof(line), f) && count < MAX_BENCHMARKS){
+        if(sscanf(line, " {\"name\": \"%31[^\"]\"", results[count].name) != 1) continue;
+        results[count].ns = read_number(line, "ns_per_iter");
+        results[count].cycles = read_number(line, "cycles_per_iter");
+        results[count].instructions = read_number(line, "instructions_per_iter");
+        count++;
+    }
+    fclose(f);
+    return count;
+}
+
+
+// compares instructions if both runs have them, otherwise time. Returns
+// the number of benchmarks whose instructions went up more than the
+// threshold; time is only a warning
+static int compare_results(const struct result* results, int count,
+                           const struct result* baseline, int baseline_count, double threshold){
+    int regressions = 0;
+    int checked = 0;
+    for(int i=0; i<count; i++){
+        const struct result* old = NULL;
+        for(int j=0; j<baseline_count; j++){
+            if(strcmp(baseline[j].name, results[i].name) == 0) old = &baseline[j];
+        }
+        if(!old){
+            fprintf(stderr, "%-20s new\n", results[i].name);
+            continue;
+        }
+
+        bool use_instructions = results[i].instructions >= 0 && old->instructions >= 0;
+        double now = use_instructions ? results[i].instructions : results[i].ns;
+        double before = use_instructions ? old->instructions : old->ns;
+        double change = before > 0 ? (now - before) / before * 100 : 0;
+
+        bool slower = change > threshold;
+        bool regressed = slower && use_instructions;
+        fprintf(stderr, "%-20s %10.2f -> %10.2f %s  %+6.1f%%%s\n", results[i].name, before, now,
+                use_instructions ? "instr" : "ns   ", change,
+                regressed ? "  REGRESSION" : slower ? "  slower? (time only, not failing)" : "");
+        regressions += regressed;
+        checked += use_instructions;
+    }
+    if(!checked)
+        fprintf(stderr, "no instruction counts on both sides, so nothing was checked\n");
+    return regressions;
+}
+
+
+
+int main(int argc, char** argv){
+
+    const char* output_path = NULL;
+    const char* baseline_path = NULL;
+    double threshold = DEFAULT_THRESHOLD;
+
+    for(int i=1; i<argc; i++){
+        if(strcmp(argv[i], "-o") == 0 && i+1 < argc) output_path = argv[++i];
+        else if(strcmp(argv[i], "-b") == 0 && i+1 < argc) baseline_path = argv[++i];
+        else if(strcmp(argv[i], "-t") == 0 && i+1 < argc) threshold = atof(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [-o results.json] [-b baseline.json] [-t percent]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    perf_initialize();
+    if(perf_group < 0)
+        fprintf(stderr, "perf counters not available, only timing\n");
+
+    struct result results[MAX_BENCHMARKS];
+    for(int i=0; i<BENCHMARK_COUNT; i++){
+        run_benchmark(&benchmarks[i], &results[i]);
+    }
+
+    write_results(stdout, results, BENCHMARK_COUNT);
+    if(output_path){
+        FILE* f = fopen(output_path, "w");
+        if(!f){ perror(output_path); return 2; }
+        write_results(f, results, BENCHMARK_COUNT);
+        fclose(f);
+    }
+
+    if(baseline_path){
+        struct result baseline[MAX_BENCHMARKS];
+        int baseline_count = read_results(baseline_path, baseline);
+        if(baseline_count < 0) return 2;
+        if(compare_results(results, BENCHMARK_COUNT, baseline, baseline_count, threshold))
+            return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,388 @@
+#include "broker.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+#define CONNECT     0x10
+#define CONNACK     0x20
+#define PUBLISH     0x30
+#define SUBSCRIBE   0x80
+#define SUBACK      0x90
+#define UNSUBSCRIBE 0xA0
+#define UNSUBACK    0xB0
+#define PINGREQ     0xC0
+#define PINGRESP    0xD0
+#define DISCONNECT  0xE0
+
+#define TYPE_MASK   0xF0
+#define RETAIN      0x01
+#define QOS_MASK    0x06
+
+#define RECEIVE_BUFFER (BROKER_PAYLOAD_LENGTH + 2 * BROKER_TOPIC_LENGTH)
+#define MAX_SUBSCRIPTIONS 8
+
+
+struct client {
+    int fd;
+    uint8_t buffer[RECEIVE_BUFFER];
+    int length;
+    char subscriptions[MAX_SUBSCRIPTIONS][BROKER_TOPIC_LENGTH];
+    int subscription_count;
+};
+
+struct retained {
+    char topic[BROKER_TOPIC_LENGTH];
+    uint8_t payload[BROKER_PAYLOAD_LENGTH];
+    int length;
+};
+
+
+static int listener_fd = -1;
+static struct client clients[BROKER_MAX_CLIENTS];
+static struct retained retained[BROKER_MAX_RETAINED];
+static int retained_count = 0;
+static void (*listener)(const char*, const uint8_t*, int, bool) = NULL;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+/*****************************************************/
+/****************** Helper Functions *****************/
+/*****************************************************/
+
+// + matches one level, # the rest
+static bool topic_matches(const char* filter, const char* topic){
+    while(*filter){
+        if(*filter == '#') return true;
+        if(*filter == '+'){
+            while(*topic && *topic != '/') topic++;
+            filter++;
+            continue;
+        }
+        if(*filter != *topic) return false;
+        filter++;
+        topic++;
+    }
+    return *topic == 0;
+}
+
+
+static void send_all(int fd, const uint8_t* data, int length){
+    while(length > 0){
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return;
+        data += n;
+        length -= n;
+    }
+}
+
+
+static void send_publish(int fd, const char* topic, const uint8_t* payload, int length, bool retain){
+    uint8_t header[8 + BROKER_TOPIC_LENGTH];
+    int topic_length = strlen(topic);
+    int remaining = 2 + topic_length + length;
+    int n = 0;
+
+    header[n++] = PUBLISH | (retain ? RETAIN : 0);
+    do {
+        uint8_t byte = remaining % 128;
+        remaining /= 128;
+        if(remaining > 0) byte |= 0x80;
+        header[n++] = byte;
+    } while(remaining > 0);
+    header[n++] = topic_length >> 8;
+    header[n++] = topic_length;
+    memcpy(header + n, topic, topic_length);
+    n += topic_length;
+
+    send_all(fd, header, n);
+    send_all(fd, payload, length);
+}
+
+
+static void store_retained(const char* topic, const uint8_t* payload, int length){
+    for(int i=0; i<retained_count; i++){
+        if(strcmp(retained[i].topic, topic) != 0) continue;
+        if(length == 0){
+            // an empty retained message deletes it
+            retained[i] = retained[--retained_count];
+        }
+        else {
+            memcpy(retained[i].payload, payload, length);
+            retained[i].length = length;
+        }
+        return;
+    }
+    if(length == 0 || retained_count == BROKER_MAX_RETAINED) return;
+    struct retained* r = &retained[retained_count++];
+    snprintf(r->topic, sizeof(r->topic), "%s", topic);
+    memcpy(r->payload, payload, length);
+    r->length = length;
+}
+
+
+// caller holds the lock
+static void deliver(const char* topic, const uint8_t* payload, int length, bool retain){
+    if(length > BROKER_PAYLOAD_LENGTH) return;
+    if(retain) store_retained(topic, payload, length);
+
+    for(int i=0; i<BROKER_MAX_CLIENTS; i++){
+        struct client* c = &clients[i];
+        if(c->fd < 0) continue;
+        for(int j=0; j<c->subscription_count; j++){
+            if(topic_matches(c->subscriptions[j], topic)){
+                send_publish(c->fd, topic, payload, length, false);
+                break;
+            }
+        }
+    }
+}
+
+
+static void drop_client(struct client* c){
+    close(c->fd);
+    c->fd = -1;
+    c->length = 0;
+    c->subscription_count = 0;
+}
+
+
+
+/*****************************************************/
+/****************** Packets **************************/
+/*****************************************************/
+
+// reads a 2 byte length string into out. Returns bytes used, or -1
+static int get_string(const uint8_t* p, int available, char* out, int max){
+    if(available < 2) return -1;
+    int length = (p[0] << 8) | p[1];
+    if(length + 2 > available || length >= max) return -1;
+    memcpy(out, p + 2, length);
+    out[length] = 0;
+    return length + 2;
+}
+
+
+static void handle_subscribe(struct client* c, const uint8_t* p, int length){
+    if(length < 2) return;
+    uint8_t reply[4 + MAX_SUBSCRIPTIONS] = {SUBACK, 2, p[0], p[1]};
+    int granted = 0;
+    int used = 2;
+    char topic[BROKER_TOPIC_LENGTH];
+
+    while(used < length && granted < MAX_SUBSCRIPTIONS){
+        int n = get_string(p + used, length - used, topic, sizeof(topic));
+        if(n < 0 || used + n >= length) break;
+        used += n + 1;      // and the requested qos
+
+        if(c->subscription_count < MAX_SUBSCRIPTIONS){
+            strcpy(c->subscriptions[c->subscription_count++], topic);
+            reply[4 + granted++] = 0;
+        }
+        else {
+            reply[4 + granted++] = 0x80;
+        }
+    }
+    reply[1] = 2 + granted;
+    send_all(c->fd, reply, 4 + granted);
+
+    // then anything retained that matches
+    for(int i=0; i<retained_count; i++){
+        for(int j=0; j<c->subscription_count; j++){
+            if(topic_matches(c->subscriptions[j], retained[i].topic)){
+                send_publish(c->fd, retained[i].topic, retained[i].payload, retained[i].length, true);
+                break;
+            }
+        }
+    }
+}
+
+
+static void handle_publish(uint8_t header, const uint8_t* p, int length){
+    char topic[BROKER_TOPIC_LENGTH];
+    int used = get_string(p, length, topic, sizeof(topic));
+    if(used < 0) return;
+    if(header & QOS_MASK) used += 2;        // we don't do qos, just skip the id
+    if(used > length) return;
+
+    bool retain = header & RETAIN;
+    deliver(topic, p + used, length - used, retain);
+    if(listener) listener(topic, p + used, length - used, retain);
+}
+
+
+// handles every whole packet in the client's buffer. Returns false if the
+// client should be dropped
+static bool handle_packets(struct client* c){
+    while(c->length >= 2){
+        int remaining = 0, shift = 0, used = 1;
+        while(true){
+            if(used >= c->length) return true;      // not all here yet
+            uint8_t byte = c->buffer[used++];
+            remaining |= (byte & 0x7F) << shift;
+            if(!(byte & 0x80)) break;
+            shift += 7;
+            if(shift > 21) return false;
+        }
+        if(used + remaining > RECEIVE_BUFFER) return false;
+        if(used + remaining > c->length) return true;
+
+        uint8_t header = c->buffer[0];
+        const uint8_t* p = c->buffer + used;
+        switch(header & TYPE_MASK){
+        case CONNECT: {
+            uint8_t reply[4] = {CONNACK, 2, 0, 0};
+            send_all(c->fd, reply, 4);
+            break;
+        }
+        case SUBSCRIBE:
+            handle_subscribe(c, p, remaining);
+            break;
+        case UNSUBSCRIBE: {
+            uint8_t reply[4] = {UNSUBACK, 2, p[0], p[1]};
+            send_all(c->fd, reply, 4);
+            break;
+        }
+        case PUBLISH:
+            handle_publish(header, p, remaining);
+            break;
+        case PINGREQ: {
+            uint8_t reply[2] = {PINGRESP, 0};
+            send_all(c->fd, reply, 2);
+            break;
+        }
+        case DISCONNECT:
+            return false;
+        }
+
+        int total = used + remaining;
+        memmove(c->buffer, c->buffer + total, c->length - total);
+        c->length -= total;
+    }
+    return true;
+}
+
+
+
+/*****************************************************/
+/****************** Broker ***************************/
+/*****************************************************/
+
+int broker_start(const char* address_text, int port){
+    for(int i=0; i<BROKER_MAX_CLIENTS; i++) clients[i].fd = -1;
+
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if(inet_pton(AF_INET, address_text, &address.sin_addr) != 1){
+        errno = EINVAL;
+        return -1;
+    }
+
+    listener_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(listener_fd < 0) return -1;
+    int one = 1;
+    setsockopt(listener_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    if(bind(listener_fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener_fd, 8) != 0){
+        close(listener_fd);
+        listener_fd = -1;
+        return -1;
+    }
+
+    socklen_t size = sizeof(address);
+    getsockname(listener_fd, (struct sockaddr*)&address, &size);
+    return ntohs(address.sin_port);
+}
+
+
+void broker_poll(int timeout_ms){
+    struct pollfd fds[BROKER_MAX_CLIENTS + 1];
+    int count = 0;
+
+    fds[count++] = (struct pollfd){listener_fd, POLLIN, 0};
+    for(int i=0; i<BROKER_MAX_CLIENTS; i++){
+        if(clients[i].fd >= 0) fds[count++] = (struct pollfd){clients[i].fd, POLLIN, 0};
+    }
+    if(poll(fds, count, timeout_ms) <= 0) return;
+
+    pthread_mutex_lock(&lock);
+
+    for(int i=0; i<BROKER_MAX_CLIENTS; i++){
+        struct client* c = &clients[i];
+        if(c->fd < 0) continue;
+        bool ready = false;
+        for(int j=1; j<count; j++){
+            if(fds[j].fd == c->fd && fds[j].revents) ready = true;
+        }
+        if(!ready) continue;
+
+        ssize_t n = recv(c->fd, c->buffer + c->length, RECEIVE_BUFFER - c->length, 0);
+        if(n <= 0){
+            drop_client(c);
+            continue;
+        }
+        c->length += n;
+        if(!handle_packets(c)) drop_client(c);
+    }
+
+    if(fds[0].revents & POLLIN){
+        int fd = accept(listener_fd, NULL, NULL);
+        for(int i=0; fd >= 0 && i<BROKER_MAX_CLIENTS; i++){
+            if(clients[i].fd < 0){
+                clients[i].fd = fd;
+                fd = -1;
+            }
+        }
+        if(fd >= 0) close(fd);      // full
+    }
+
+    pthread_mutex_unlock(&lock);
+}
+
+
+void broker_stop(){
+    pthread_mutex_lock(&lock);
+    for(int i=0; i<BROKER_MAX_CLIENTS; i++){
+        if(clients[i].fd >= 0) drop_client(&clients[i]);
+    }
+    if(listener_fd >= 0) close(listener_fd);
+    listener_fd = -1;
+    pthread_mutex_unlock(&lock);
+}
+
+
+void broker_publish(const char* topic, const uint8_t* payload, int length, bool retain){
+    pthread_mutex_lock(&lock);
+    deliver(topic, payload, length, retain);
+    pthread_mutex_unlock(&lock);
+}
+
+
+int broker_get_retained(const char* topic, uint8_t* payload, int max){
+    int length = -1;
+    pthread_mutex_lock(&lock);
+    for(int i=0; i<retained_count; i++){
+        if(strcmp(retained[i].topic, topic) == 0){
+            length = retained[i].length < max ? retained[i].length : max;
+            memcpy(payload, retained[i].payload, length);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return length;
+}
+
+
+void broker_set_listener(void (*l)(const char* topic, const uint8_t* payload, int length, bool retain)){
+    pthread_mutex_lock(&lock);
+    listener = l;
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,40 @@
+#ifndef BROKER_H
+#define BROKER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Stand-in MQTT broker for testing the telemetry on a PC: MQTT 3.1.1,
+// QoS 0 only, retained messages, + and # wildcards, no auth. Enough for
+// the firmware's client and for mosquitto_sub/mosquitto_pub to talk to it.
+//
+// broker_poll does all the work, so run it in a loop on one thread. The
+// other calls are safe from any thread.
+
+#define BROKER_MAX_CLIENTS 16
+#define BROKER_MAX_RETAINED 32
+#define BROKER_TOPIC_LENGTH 64
+#define BROKER_PAYLOAD_LENGTH 1024
+
+
+// listens on address, a dotted ip like "127.0.0.1", or "0.0.0.0" for every
+// interface. port 0 picks a free one. Returns the port, or -1
+int broker_start(const char* address, int port);
+
+void broker_poll(int timeout_ms);
+
+void broker_stop();
+
+// publish as if a client had
+void broker_publish(const char* topic, const uint8_t* payload, int length, bool retain);
+
+// copies the retained message for topic. Returns its length, or -1 if
+// there isn't one
+int broker_get_retained(const char* topic, uint8_t* payload, int max);
+
+// called on the broker's thread for every message published by a client
+void broker_set_listener(void (*listener)(const char* topic, const uint8_t* payload, int length, bool retain));
+
+
+#endif
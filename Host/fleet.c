@@ -0,0 +1,400 @@
+// Runs lots of thermostats at once, each controlling its own simulated room
+// (see plant.h), and prints comfort and energy statistics for the whole lot.
+// Used for tuning control parameters across many different buildings.
+//
+//   fleet [-n instances] [-d days] [-j threads] [-t threshold] [-s setting]
+//         [-r seed] [--scaling]
+//
+// Every instance gets its own room, picked at random from the seed, so the
+// results are the same no matter how many threads are used. --scaling runs
+// the same fleet with 1, 2, 4... threads up to -j and prints the speedup.
+//
+// Threads share the instances with work stealing: each thread starts with
+// an equal slice and, when it runs out, takes half of what's left in the
+// busiest-looking other slice. That way slow instances on one thread don't
+// leave the others idle.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "seven_seg.h"
+#include "thermostat.h"
+#include "ui.h"
+#include "host_i2c.h"
+#include "plant.h"
+
+
+#define DEFAULT_INSTANCES 1000
+#define DEFAULT_DAYS 1
+#define DEFAULT_SETTING 700
+#define DEFAULT_SEED 1
+#define MAX_THREADS 256
+
+#define SECONDS_PER_DAY 86400
+#define STEP_SECONDS 1          // plant and relay are updated every second
+#define SENSE_SECONDS (SENSE_INTERVAL / 1000)
+#define COMFORT_BAND 1.0        // degrees outside setting..setting+threshold that still count as comfortable
+#define CACHE_LINE 64
+
+
+struct settings {
+    int instances;
+    int days;
+    int threads;
+    int threshold;
+    int setting;
+    uint64_t seed;
+};
+
+// on its own cache lines so threads don't slow each other down
+struct instance {
+    _Alignas(CACHE_LINE) struct thermostat thermostat;
+    struct plant plant;
+    struct host_i2c_bus bus;
+    double heater_kw;
+
+    // results
+    double degree_minutes;      // time outside the comfort band
+    double abs_error_sum;       // for mean |temperature - setting|
+    double heater_hours;
+    int cycles;
+};
+
+// next and end of a thread's slice, packed so they can be changed together
+struct work_slice {
+    _Alignas(CACHE_LINE) _Atomic uint64_t range;
+    int completed;
+    int stolen;
+};
+
+struct fleet {
+    const struct settings* settings;
+    struct instance* instances;
+    struct work_slice slices[MAX_THREADS];
+    int threads;
+};
+
+struct worker {
+    struct fleet* fleet;
+    int index;
+    pthread_t thread;
+};
+
+
+
+/*****************************************************/
+/****************** Helper Functions *****************/
+/*****************************************************/
+
+static uint64_t pack(uint32_t next, uint32_t end){
+    return ((uint64_t)end << 32) | next;
+}
+
+static uint32_t range_next(uint64_t range){
+    return (uint32_t)range;
+}
+
+static uint32_t range_end(uint64_t range){
+    return (uint32_t)(range >> 32);
+}
+
+static double now_seconds(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void* a, const void* b){
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+
+
+/*****************************************************/
+/****************** Simulation ***********************/
+/*****************************************************/
+
+static void setup_instance(struct instance* in, const struct settings* s, int index){
+    uint64_t random = s->seed ^ ((uint64_t)index * 0xD1B54A32D192ED03ull);
+
+    memset(in, 0, sizeof(*in));
+    plant_random_room(&in->plant, &random);
+    in->heater_kw = plant_random_between(&random, 1.5, 6);
+
+    host_i2c_select(&in->bus);
+    plant_thermostat_initialize(&in->thermostat, s->setting);
+    in->thermostat.threshold = s->threshold;
+    seven_seg_begin(&in->thermostat.display);
+}
+
+
+// the same sequence the sensor, ui, display and relay tasks go through on
+// the pico, one second at a time
+static void run_instance(struct instance* in, const struct settings* s){
+    struct thermostat* t = &in->thermostat;
+    int relay_state = OFF;
+    long seconds = (long)s->days * SECONDS_PER_DAY;
+
+    host_i2c_select(&in->bus);
+
+    for(long second=0; second<seconds; second+=STEP_SECONDS){
+        if(second % SENSE_SECONDS == 0){
+            plant_sense(&in->plant, t);
+
+            struct ui_message message = {UI_EVENT_SAMPLE, second};
+            struct display_request request;
+            ui_handle_event(t, &message, &request);
+            ui_show(&t->display, &request);
+        }
+
+        int new_state = thermostat_update_relay(t);
+        if(new_state == ON && relay_state == OFF) in->cycles++;
+        relay_state = new_state;
+
+        plant_step(&in->plant, relay_state == ON, STEP_SECONDS);
+
+        // comfort is judged on the real room temperature, not the sensor's
+        double setting = t->temperature_setting / 10.0;
+        double low = setting - COMFORT_BAND;
+        double high = setting + t->threshold / 10.0 + COMFORT_BAND;
+        double temperature = in->plant.temperature;
+        double minutes = STEP_SECONDS / 60.0;
+        if(temperature < low) in->degree_minutes += (low - temperature) * minutes;
+        if(temperature > high) in->degree_minutes += (temperature - high) * minutes;
+        in->abs_error_sum += temperature > setting ? temperature - setting : setting - temperature;
+        if(relay_state == ON) in->heater_hours += STEP_SECONDS / 3600.0;
+    }
+
+    host_i2c_select(NULL);
+}
+
+
+
+/*****************************************************/
+/****************** Work stealing ********************/
+/*****************************************************/
+
+// take one instance from our own slice. -1 if it's empty
+static int take_own(struct work_slice* slice){
+    uint64_t range = atomic_load(&slice->range);
+    while(range_next(range) < range_end(range)){
+        uint64_t taken = pack(range_next(range) + 1, range_end(range));
+        if(atomic_compare_exchange_weak(&slice->range, &range, taken))
+            return range_next(range);
+    }
+    return -1;
+}
+
+// move the back half of the fullest other slice into ours. false if
+// there's nothing left anywhere
+static bool steal(struct fleet* fleet, int thief){
+    while(true){
+        int victim = -1;
+        uint32_t most = 0;
+        for(int i=0; i<fleet->threads; i++){
+            uint64_t range = atomic_load(&fleet->slices[i].range);
+            uint32_t left = range_end(range) - range_next(range);
+            if(i != thief && range_next(range) < range_end(range) && left > most){
+                most = left;
+                victim = i;
+            }
+        }
+        if(victim < 0) return false;
+
+        struct work_slice* slice = &fleet->slices[victim];
+        uint64_t range = atomic_load(&slice->range);
+        uint32_t next = range_next(range), end = range_end(range);
+        if(next >= end) continue;
+
+        uint32_t split = end - (end - next + 1) / 2;
+        if(atomic_compare_exchange_strong(&slice->range, &range, pack(next, split))){
+            // our slice is empty, so nobody else is touching it
+            atomic_store(&fleet->slices[thief].range, pack(split, end));
+            fleet->slices[thief].stolen += end - split;
+            return true;
+        }
+    }
+}
+
+static void* worker_thread(void* arg){
+    struct worker* w = arg;
+    struct fleet* fleet = w->fleet;
+    struct work_slice* slice = &fleet->slices[w->index];
+
+    while(true){
+        int index = take_own(slice);
+        if(index < 0){
+            if(!steal(fleet, w->index)) break;
+            continue;
+        }
+        setup_instance(&fleet->instances[index], fleet->settings, index);
+        run_instance(&fleet->instances[index], fleet->settings);
+        slice->completed++;
+    }
+    return NULL;
+}
+
+
+// returns wall clock seconds
+static double run_fleet(struct fleet* fleet, int threads){
+    int instances = fleet->settings->instances;
+    struct worker workers[MAX_THREADS];
+
+    fleet->threads = threads;
+    for(int i=0; i<threads; i++){
+        uint32_t begin = (uint64_t)instances * i / threads;
+        uint32_t end = (uint64_t)instances * (i+1) / threads;
+        atomic_store(&fleet->slices[i].range, pack(begin, end));
+        fleet->slices[i].completed = 0;
+        fleet->slices[i].stolen = 0;
+    }
+
+    double start = now_seconds();
+    for(int i=0; i<threads; i++){
+        workers[i].fleet = fleet;
+        workers[i].index = i;
+        if(pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i]) != 0){
+            perror("pthread_create");
+            exit(2);
+        }
+    }
+    for(int i=0; i<threads; i++){
+        pthread_join(workers[i].thread, NULL);
+    }
+    return now_seconds() - start;
+}
+
+
+
+/*****************************************************/
+/****************** Results **************************/
+/*****************************************************/
+
+static void print_distribution(const char* name, double* values, int count){
+    double total = 0;
+    for(int i=0; i<count; i++) total += values[i];
+    qsort(values, count, sizeof(double), compare_doubles);
+    printf("%-26s mean %9.2f  p50 %9.2f  p95 %9.2f  max %9.2f\n", name, total / count,
+            values[count / 2], values[(int)(count * 0.95)], values[count - 1]);
+}
+
+static void print_results(const struct fleet* fleet){
+    const struct settings* s = fleet->settings;
+    int count = s->instances;
+    double* values = malloc(count * sizeof(double));
+    double steps = (double)s->days * SECONDS_PER_DAY / STEP_SECONDS;
+    double total_kwh = 0;
+
+    printf("%d thermostats, %d day(s), setting %.1fF, threshold %.1fF\n",
+            count, s->days, s->setting / 10.0, s->threshold / 10.0);
+
+    for(int i=0; i<count; i++) values[i] = fleet->instances[i].degree_minutes / s->days;
+    print_distribution("degree-minutes/day", values, count);
+
+    for(int i=0; i<count; i++) values[i] = fleet->instances[i].abs_error_sum / steps;
+    print_distribution("mean |error| (F)", values, count);
+
+    for(int i=0; i<count; i++) values[i] = fleet->instances[i].heater_hours / s->days;
+    print_distribution("heater hours/day", values, count);
+
+    for(int i=0; i<count; i++){
+        values[i] = fleet->instances[i].heater_hours * fleet->instances[i].heater_kw / s->days;
+        total_kwh += values[i] * s->days;
+    }
+    print_distribution("kWh/day", values, count);
+
+    for(int i=0; i<count; i++) values[i] = (double)fleet->instances[i].cycles / s->days;
+    print_distribution("relay cycles/day", values, count);
+
+    printf("total energy %.1f kWh\n", total_kwh);
+    free(values);
+}
+
+static void print_threads(const struct fleet* fleet){
+    for(int i=0; i<fleet->threads; i++){
+        printf("  thread %3d: %6d instances, %6d stolen\n", i,
+                fleet->slices[i].completed, fleet->slices[i].stolen);
+    }
+}
+
+// a quick way to check different thread counts gave the same answer
+static double checksum(const struct fleet* fleet){
+    double sum = 0;
+    for(int i=0; i<fleet->settings->instances; i++){
+        sum += fleet->instances[i].degree_minutes + fleet->instances[i].heater_hours
+            + fleet->instances[i].cycles;
+    }
+    return sum;
+}
+
+
+
+int main(int argc, char** argv){
+
+    struct settings s = {
+        .instances = DEFAULT_INSTANCES,
+        .days = DEFAULT_DAYS,
+        .threads = (int)sysconf(_SC_NPROCESSORS_ONLN),
+        .threshold = TEMP_THRESHOLD,
+        .setting = DEFAULT_SETTING,
+        .seed = DEFAULT_SEED,
+    };
+    bool scaling = false;
+
+    for(int i=1; i<argc; i++){
+        if(strcmp(argv[i], "-n") == 0 && i+1 < argc) s.instances = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-d") == 0 && i+1 < argc) s.days = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-j") == 0 && i+1 < argc) s.threads = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-t") == 0 && i+1 < argc) s.threshold = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-s") == 0 && i+1 < argc) s.setting = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-r") == 0 && i+1 < argc) s.seed = strtoull(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "--scaling") == 0) scaling = true;
+        else {
+            fprintf(stderr, "usage: %s [-n instances] [-d days] [-j threads] [-t threshold] "
+                    "[-s setting] [-r seed] [--scaling]\n", argv[0]);
+            return 2;
+        }
+    }
+    if(s.instances < 1 || s.days < 1) return 2;
+    if(s.threads < 1) s.threads = 1;
+    if(s.threads > MAX_THREADS) s.threads = MAX_THREADS;
+
+    struct fleet* fleet = aligned_alloc(CACHE_LINE, sizeof(struct fleet));
+    size_t instances_size = (s.instances * sizeof(struct instance) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    memset(fleet, 0, sizeof(*fleet));
+    fleet->settings = &s;
+    fleet->instances = aligned_alloc(CACHE_LINE, instances_size);
+    if(!fleet->instances){ perror("aligned_alloc"); return 2; }
+
+    if(scaling){
+        double single = 0, first_checksum = 0;
+        for(int threads=1; ; threads = threads*2 > s.threads ? s.threads : threads*2){
+            double seconds = run_fleet(fleet, threads);
+            if(threads == 1){
+                single = seconds;
+                first_checksum = checksum(fleet);
+            }
+            printf("%3d threads: %8.3f s  %10.0f instance-days/s  speedup %5.2f  efficiency %3.0f%%%s\n",
+                    threads, seconds, s.instances * (double)s.days / seconds, single / seconds,
+                    single / seconds / threads * 100,
+                    checksum(fleet) == first_checksum ? "" : "  RESULTS DIFFER");
+            if(threads == s.threads) break;
+        }
+    }
+    else {
+        double seconds = run_fleet(fleet, s.threads);
+        print_results(fleet);
+        printf("%d threads, %.3f s, %.0f instance-days/s\n", s.threads, seconds,
+                s.instances * (double)s.days / seconds);
+        print_threads(fleet);
+    }
+
+    free(fleet->instances);
+    free(fleet);
+    return 0;
+}
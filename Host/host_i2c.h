@@ -0,0 +1,84 @@
+#ifndef HOST_I2C_H
+#define HOST_I2C_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Fake i2c bus for running the firmware on a PC. It answers aht20 reads
+// with whatever frame was set last, and keeps a copy of the HT16K33
+// display ram so output can be checked.
+//
+// This is the hardware half of the i2c module (i2c_hw.h), so the real
+// timeout and recovery code in i2c_module.c runs on top of it. Time is
+// simulated: each transaction moves the bus clock on by as long as it
+// would take at 100kHz, and faults can be switched on to see what the
+// firmware does with them.
+//
+// Each thread talks to its own bus. There's a default one, so single
+// threaded tools don't need to care; simulations with lots of
+// thermostats select each one's bus before running it.
+//
+// Several simulated tasks can share one bus, like the sensor and display
+// tasks do on the pico. Each has its own clock, and one that wants the
+// bus while another task's transaction is still going waits for it, or
+// gives up after the lock timeout, like the mutex in i2c_hw_pico.c.
+
+#define HOST_DISPLAY_DIGITS 5
+#define HOST_AHT20_FRAME_LENGTH 6
+
+// chances are per million transactions
+struct host_i2c_faults {
+    uint32_t nack;          // device doesn't answer this time
+    uint32_t stretch;       // device holds SCL low for up to twice the timeout
+    uint32_t stuck;         // device holds SDA low until the bus is cleared
+    uint64_t seed;
+};
+
+struct host_i2c_bus {
+    uint8_t aht20_frame[HOST_AHT20_FRAME_LENGTH];
+    uint8_t display_ram[HOST_DISPLAY_DIGITS];
+    bool display_on;
+    bool display_changed;
+
+    uint32_t time_us;       // when there's no task
+    struct host_i2c_faults faults;
+    bool stuck;
+    uint32_t recoveries;
+    uint64_t free_at;       // on the tasks' clocks, when the last transaction finished
+};
+
+struct host_i2c_task {
+    uint64_t time_us;
+    uint64_t lock_wait_us;  // waiting for other tasks, in total
+    uint32_t lock_timeouts;
+    // called before every transaction, so a simulation can run any task
+    // that's further behind first. Can be NULL
+    void (*yield)();
+};
+
+
+// route this thread's i2c calls to bus. NULL goes back to the default
+void host_i2c_select(struct host_i2c_bus* bus);
+
+void host_i2c_reset();
+
+// frame must be AHT20_FRAME_LENGTH bytes
+void host_i2c_set_aht20_frame(const uint8_t* frame);
+
+// copies the display ram. returns true if the display is on
+bool host_i2c_get_display(uint8_t* digits);
+
+// true if the display has been written since the last call
+bool host_i2c_display_changed();
+
+void host_i2c_set_faults(const struct host_i2c_faults* faults);
+
+struct host_i2c_bus* host_i2c_current();
+
+// the task this thread's i2c calls come from, with its own clock. NULL to
+// go back to the bus's clock and no waiting
+void host_i2c_set_task(struct host_i2c_task* task);
+
+
+#endif
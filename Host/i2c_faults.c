@@ -0,0 +1,283 @@
+// Runs the sensor and display tasks against a fake i2c bus that drops,
+// stretches and jams transactions, to check the firmware keeps going and
+// that nothing a task does on the bus takes longer than the i2c module's
+// worst case says it can.
+//
+//   i2c_faults [-n samples] [-p nack] [-s stretch] [-j stuck] [-r seed]
+//
+// Fault chances are per million transactions. Time is simulated, so this
+// measures what the pico would spend on the bus, not how fast the PC is.
+//
+// The two tasks share the bus like they do on the pico: each has its own
+// clock, and when one wants the bus while the other is in the middle of a
+// transaction it has to wait, or gives up after I2C_LOCK_TIMEOUT_MS. The
+// gaps between samples and button presses are much shorter than the real
+// ones so the tasks run into each other a lot.
+//
+// Each trigger, read and redraw is compared with a bound worked out from
+// the transactions it makes. Before each one the task can wait for the
+// other task's longest transaction, not the whole mutex timeout, so a bus
+// that stays held for longer than that shows up. The exit code is 1 if
+// anything went over, or if a task ever gave up waiting for the bus.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include "aht20.h"
+#include "i2c_module.h"
+#include "seven_seg.h"
+#include "thermostat.h"
+#include "ui.h"
+#include "latency.h"
+#include "host_i2c.h"
+
+
+#define DEFAULT_SAMPLES 100000
+#define DEFAULT_NACK 20000
+#define DEFAULT_STRETCH 20000
+#define DEFAULT_STUCK 5000
+#define DEFAULT_SEED 1
+#define AHT20_ADDRESS 0x38
+#define HT16K33_ADDRESS 0x70
+#define CONVERSION_US 80000     // the sensor task's wait between trigger and read
+#define SAMPLE_GAP_US 19997     // wait before the next trigger
+#define BUTTON_GAP_US 7013      // between simulated button presses
+#define STACK_SIZE (64 * 1024)
+
+// 71.6F and 45%, as the sensor would send it
+static const uint8_t frame[AHT20_FRAME_LENGTH] = {0x1c, 0x73, 0x33, 0x35, 0xc2, 0x8f};
+
+
+// the things the tasks do on the bus
+enum operation { OP_TRIGGER, OP_READ, OP_DRAW, OP_COUNT };
+
+static const char* const operation_names[OP_COUNT] = {"trigger", "read", "draw"};
+
+struct operation_stats {
+    uint32_t bound_us;
+    uint32_t bus_us;            // the bound without waiting for the other task
+    uint32_t count;
+    uint32_t over_bound;
+    uint32_t over_bus;          // would have failed if the bound left out the wait
+    struct latency_histogram times;
+};
+
+struct sim_task {
+    struct host_i2c_task bus;
+    ucontext_t context;
+    bool done;
+    char stack[STACK_SIZE];
+};
+
+
+static struct thermostat thermostat;
+static struct operation_stats operations[OP_COUNT];
+static struct sim_task sensor_task, display_task;
+static struct sim_task* running;
+static ucontext_t scheduler;
+static int samples = DEFAULT_SAMPLES;
+static int good_readings;
+static bool sample_waiting;
+
+
+
+// the most each operation can hold its task up, worked out from the
+// transactions it makes: triggering the aht20, reading it, and the display
+// turning on and writing every digit. Each of those can first wait for
+// the longest transaction the other task makes, timed out and cleared
+static void set_bounds(){
+    uint32_t sensor_holds = i2c_module_worst_case_us(AHT20_FRAME_LENGTH);
+    uint32_t display_holds = i2c_module_worst_case_us(2);
+
+    operations[OP_TRIGGER].bus_us = i2c_module_worst_case_us(3);
+    operations[OP_TRIGGER].bound_us = operations[OP_TRIGGER].bus_us + display_holds;
+    operations[OP_READ].bus_us = i2c_module_worst_case_us(AHT20_FRAME_LENGTH);
+    operations[OP_READ].bound_us = operations[OP_READ].bus_us + display_holds;
+    operations[OP_DRAW].bus_us = i2c_module_worst_case_us(1)
+                               + SEVEN_SEG_DIGITS * i2c_module_worst_case_us(2);
+    operations[OP_DRAW].bound_us = operations[OP_DRAW].bus_us
+                                 + (1 + SEVEN_SEG_DIGITS) * sensor_holds;
+    for(int i=0; i<OP_COUNT; i++) latency_reset(&operations[i].times);
+}
+
+
+// lets the other task run if it's further behind
+static void yield(){
+    swapcontext(&running->context, &scheduler);
+}
+
+static void sleep_us(uint32_t us){
+    running->bus.time_us += us;
+    yield();
+}
+
+
+static uint64_t start_operation(){
+    return running->bus.time_us;
+}
+
+static void end_operation(enum operation op, uint64_t start){
+    struct operation_stats* s = &operations[op];
+    uint32_t elapsed = running->bus.time_us - start;
+
+    s->count++;
+    latency_record(&s->times, elapsed);
+    if(elapsed > s->bound_us) s->over_bound++;
+    if(elapsed > s->bus_us) s->over_bus++;
+}
+
+
+
+// like manage_sensor in main.c, for one zone
+static void run_sensor(){
+    for(int i=0; i<samples; i++){
+        uint64_t start = start_operation();
+        bool ok = aht20_start_measurement(&thermostat.sensor);
+        end_operation(OP_TRIGGER, start);
+        sleep_us(CONVERSION_US);
+
+        if(ok){
+            start = start_operation();
+            ok = aht20_read_measurement(&thermostat.sensor);
+            end_operation(OP_READ, start);
+        }
+        if(ok){
+            thermostat_new_reading(&thermostat);
+            good_readings++;
+            sample_waiting = true;
+        }
+        sleep_us(SAMPLE_GAP_US);
+    }
+    sensor_task.done = true;
+}
+
+
+// the buttons and ui task: a sample from the sensor task if there is one,
+// otherwise a button press or the screen timing out
+static void run_display(){
+    for(int i=0; !sensor_task.done; i++){
+        struct ui_message message = {UI_EVENT_SAMPLE, i};
+        struct display_request request;
+
+        if(sample_waiting) sample_waiting = false;
+        else if(i % 3 == 0) message.event = UI_EVENT_UP;
+        else if(i % 3 == 1) message.event = UI_EVENT_TIMEOUT;
+        else message.event = UI_EVENT_CYCLE;
+
+        ui_handle_event(&thermostat, &message, &request);
+        uint64_t start = start_operation();
+        ui_show(&thermostat.display, &request);
+        end_operation(OP_DRAW, start);
+        thermostat_update_relay(&thermostat);
+
+        sleep_us(BUTTON_GAP_US);
+    }
+    display_task.done = true;
+}
+
+
+static void start_task(struct sim_task* t, void (*run)()){
+    t->bus = (struct host_i2c_task){0};
+    t->bus.yield = yield;
+    t->done = false;
+    getcontext(&t->context);
+    t->context.uc_stack.ss_sp = t->stack;
+    t->context.uc_stack.ss_size = sizeof(t->stack);
+    t->context.uc_link = &scheduler;
+    makecontext(&t->context, run, 0);
+}
+
+
+// always runs whichever task's clock is furthest behind, so the bus gets
+// handed out in the order the pico would
+static void run_tasks(){
+    while(!sensor_task.done || !display_task.done){
+        if(sensor_task.done) running = &display_task;
+        else if(display_task.done) running = &sensor_task;
+        else running = sensor_task.bus.time_us <= display_task.bus.time_us
+                     ? &sensor_task : &display_task;
+
+        host_i2c_set_task(&running->bus);
+        swapcontext(&scheduler, &running->context);
+    }
+    host_i2c_set_task(NULL);
+}
+
+
+
+static void print_device(const char* name, int addr){
+    const struct i2c_device_stats* d = i2c_module_get_stats(addr);
+    if(!d) return;
+    printf("%-8s %9lu transactions %7lu errors %7lu timeouts   mean %4luus  max %5luus\n",
+            name, (unsigned long)d->transactions, (unsigned long)d->errors,
+            (unsigned long)d->timeouts,
+            (unsigned long)(d->transactions ? d->total_us / d->transactions : 0),
+            (unsigned long)d->max_us);
+}
+
+static void print_task(const char* name, const struct sim_task* t){
+    printf("%-8s waited %8lluus for the bus, %lu lock timeouts\n",
+            name, (unsigned long long)t->bus.lock_wait_us,
+            (unsigned long)t->bus.lock_timeouts);
+}
+
+
+
+int main(int argc, char** argv){
+
+    struct host_i2c_faults faults = {DEFAULT_NACK, DEFAULT_STRETCH, DEFAULT_STUCK, DEFAULT_SEED};
+
+    for(int i=1; i<argc; i++){
+        if(i+1 >= argc){
+            fprintf(stderr, "usage: %s [-n samples] [-p nack] [-s stretch] [-j stuck] [-r seed]\n", argv[0]);
+            return 2;
+        }
+        if(strcmp(argv[i], "-n") == 0) samples = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-p") == 0) faults.nack = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-s") == 0) faults.stretch = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-j") == 0) faults.stuck = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-r") == 0) faults.seed = strtoull(argv[++i], NULL, 10);
+        else { fprintf(stderr, "unknown option %s\n", argv[i]); return 2; }
+    }
+
+    // start up on a good bus, like the real one would be
+    i2c_module_initialize();
+    thermostat_initialize(&thermostat, 700);
+    seven_seg_begin(&thermostat.display);
+    aht20_initialize(&thermostat.sensor);
+    host_i2c_set_aht20_frame(frame);
+    host_i2c_set_faults(&faults);
+
+    set_bounds();
+    start_task(&sensor_task, run_sensor);
+    start_task(&display_task, run_display);
+    run_tasks();
+
+    printf("%d samples, faults per million: %lu nack, %lu stretch, %lu stuck\n",
+            samples, (unsigned long)faults.nack, (unsigned long)faults.stretch,
+            (unsigned long)faults.stuck);
+    print_device("aht20", AHT20_ADDRESS);
+    print_device("display", HT16K33_ADDRESS);
+    print_task("sensor", &sensor_task);
+    print_task("display", &display_task);
+    printf("%lu bus recoveries, %d of %d readings good, last temperature %d\n",
+            (unsigned long)i2c_module_get_bus_stats()->recoveries,
+            good_readings, samples, thermostat_get_temperature(&thermostat));
+
+    bool failed = false;
+    for(int i=0; i<OP_COUNT; i++){
+        struct operation_stats* s = &operations[i];
+        printf("%-8s %8lu  p50 %5luus  p99 %5luus  max %5luus  bound %6luus  over %lu"
+               "  (%lu without the wait)\n",
+                operation_names[i], (unsigned long)s->count,
+                (unsigned long)latency_percentile(&s->times, 50),
+                (unsigned long)latency_percentile(&s->times, 99),
+                (unsigned long)s->times.max, (unsigned long)s->bound_us,
+                (unsigned long)s->over_bound, (unsigned long)s->over_bus);
+        failed |= s->over_bound > 0;
+    }
+    failed |= sensor_task.bus.lock_timeouts || display_task.bus.lock_timeouts;
+
+    return failed ? 1 : 0;
+}
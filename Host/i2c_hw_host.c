@@ -0,0 +1,190 @@
+#include "i2c_hw.h"
+#include "i2c_module.h"
+#include "host_i2c.h"
+#include "aht20.h"
+#include <string.h>
+
+
+#define AHT20_ADDRESS 0x38
+#define HT16K33_ADDRESS 0x70
+
+#define HT16K33_DISPLAYON       0x81
+#define HT16K33_DISPLAYOFF      0x80
+
+// 100kHz: 9 clocks per byte including the ack, plus start and stop
+#define BYTE_US 90
+#define START_STOP_US 20
+#define CLEAR_US (9 * 10 + START_STOP_US)
+#define REINIT_US 50
+
+_Static_assert(HOST_AHT20_FRAME_LENGTH == AHT20_FRAME_LENGTH, "aht20 frame length");
+_Static_assert(CLEAR_US + REINIT_US <= I2C_RECOVERY_MAX_US, "recovery takes longer than i2c_hw.h says");
+
+
+static struct host_i2c_bus default_bus;
+static _Thread_local struct host_i2c_bus* bus = &default_bus;
+static _Thread_local struct host_i2c_task* task = NULL;
+
+
+
+void host_i2c_select(struct host_i2c_bus* selected){
+    bus = selected ? selected : &default_bus;
+}
+
+void host_i2c_reset(){
+    memset(bus, 0, sizeof(*bus));
+}
+
+void host_i2c_set_aht20_frame(const uint8_t* frame){
+    memcpy(bus->aht20_frame, frame, AHT20_FRAME_LENGTH);
+}
+
+bool host_i2c_get_display(uint8_t* digits){
+    memcpy(digits, bus->display_ram, HOST_DISPLAY_DIGITS);
+    return bus->display_on;
+}
+
+bool host_i2c_display_changed(){
+    bool changed = bus->display_changed;
+    bus->display_changed = false;
+    return changed;
+}
+
+void host_i2c_set_faults(const struct host_i2c_faults* faults){
+    bus->faults = *faults;
+}
+
+struct host_i2c_bus* host_i2c_current(){
+    return bus;
+}
+
+void host_i2c_set_task(struct host_i2c_task* t){
+    task = t;
+}
+
+
+
+// splitmix64, so runs are repeatable for a given seed
+static uint32_t random_below(uint32_t n){
+    uint64_t z = (bus->faults.seed += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    z ^= z >> 31;
+    return (uint32_t)(z % n);
+}
+
+
+static void advance(uint32_t us){
+    if(task) task->time_us += us;
+    else bus->time_us += us;
+}
+
+
+// decides what goes wrong with this transaction, moves the clock on, and
+// returns the result the peripheral would give
+static int transfer(int length, uint32_t timeout_us){
+    const struct host_i2c_faults* f = &bus->faults;
+    uint32_t roll = random_below(1000000);
+    if(roll < f->stuck) bus->stuck = true;
+
+    if(bus->stuck){
+        advance(timeout_us);
+        return I2C_MODULE_TIMEOUT;
+    }
+    if(roll < f->stuck + f->nack){
+        advance(START_STOP_US + BYTE_US);
+        return I2C_MODULE_ERROR;
+    }
+
+    uint32_t duration = START_STOP_US + (length + 1) * BYTE_US;
+    if(roll < f->stuck + f->nack + f->stretch)
+        duration += random_below(2 * timeout_us);
+    if(duration > timeout_us){
+        advance(timeout_us);
+        return I2C_MODULE_TIMEOUT;
+    }
+    advance(duration);
+    return length;
+}
+
+
+
+void i2c_hw_initialize(){
+    host_i2c_reset();
+}
+
+
+int i2c_hw_write(int addr, const uint8_t* data, int length, uint32_t timeout_us){
+
+    int result = transfer(length, timeout_us);
+    if(result < 0 || addr != HT16K33_ADDRESS) return result;
+
+    // single byte commands
+    if(length == 1){
+        if(data[0] == HT16K33_DISPLAYON){
+            bus->display_changed |= !bus->display_on;
+            bus->display_on = true;
+        }
+        else if(data[0] == HT16K33_DISPLAYOFF){
+            bus->display_changed |= bus->display_on;
+            bus->display_on = false;
+        }
+        return result;
+    }
+
+    // address byte followed by data. each digit is at an even address
+    int pos = data[0] / 2;
+    for(int i=1; i<length && pos < HOST_DISPLAY_DIGITS; i+=2, pos++){
+        bus->display_changed |= bus->display_ram[pos] != data[i];
+        bus->display_ram[pos] = data[i];
+    }
+    return result;
+}
+
+
+int i2c_hw_read(int addr, uint8_t* data, int length, uint32_t timeout_us){
+
+    int result = transfer(length, timeout_us);
+    if(result < 0) return result;
+
+    memset(data, 0xff, length);     // nobody driving the bus
+    if(addr == AHT20_ADDRESS)
+        memcpy(data, bus->aht20_frame, length < AHT20_FRAME_LENGTH ? length : AHT20_FRAME_LENGTH);
+    return result;
+}
+
+
+void i2c_hw_recover(){
+    advance(bus->stuck ? CLEAR_US + REINIT_US : START_STOP_US + REINIT_US);
+    bus->stuck = false;
+    bus->recoveries++;
+}
+
+
+uint32_t i2c_hw_time_us(){
+    return task ? (uint32_t)task->time_us : bus->time_us;
+}
+
+
+// without tasks it's one thread per bus, so nothing to wait for
+bool i2c_hw_lock(uint32_t timeout_ms){
+    if(!task) return true;
+    if(task->yield) task->yield();
+
+    if(bus->free_at > task->time_us){
+        uint64_t wait = bus->free_at - task->time_us;
+        if(wait > timeout_ms * 1000ull){
+            task->time_us += timeout_ms * 1000ull;
+            task->lock_wait_us += timeout_ms * 1000ull;
+            task->lock_timeouts++;
+            return false;
+        }
+        task->time_us += wait;
+        task->lock_wait_us += wait;
+    }
+    return true;
+}
+
+void i2c_hw_unlock(){
+    if(task) bus->free_at = task->time_us;
+}
@@ -0,0 +1,59 @@
+// Stand-in MQTT broker (see broker.h) that prints everything published to
+// it, decoding telemetry batches. Point a Pico W built with MQTT_BROKER
+// set to this machine at it, or use mosquitto_pub to send a setting:
+//
+//   mqtt_broker [-p port] [-b address]
+//   mosquitto_pub -p 1883 -r -t thermostat/setting/set -m 680
+//
+// It listens on every interface so a pico on the LAN can reach it. -b
+// 127.0.0.1 keeps it to this machine.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "broker.h"
+#include "telemetry.h"
+
+
+#define DEFAULT_PORT 1883
+#define DEFAULT_ADDRESS "0.0.0.0"
+
+
+
+static void print_message(const char* topic, const uint8_t* payload, int length, bool retain){
+    printf("%s%s: %.*s\n", topic, retain ? " (retained)" : "", length, (const char*)payload);
+
+    if(strcmp(topic, TELEMETRY_TOPIC) == 0){
+        struct telemetry_sample samples[TELEMETRY_PAYLOAD];
+        int count = telemetry_decode((const char*)payload, length, samples, TELEMETRY_PAYLOAD);
+        for(int i=0; i<count; i++){
+            const struct telemetry_sample* s = &samples[i];
+            printf("  %8lus  %5.1fF  %3d%%  set %5.1fF  relay %s\n", (unsigned long)s->time,
+                    s->temperature / 10.0, s->humidity, s->setting / 10.0, s->relay ? "on" : "off");
+        }
+    }
+    fflush(stdout);
+}
+
+
+
+int main(int argc, char** argv){
+    int port = DEFAULT_PORT;
+    const char* address = DEFAULT_ADDRESS;
+
+    for(int i=1; i<argc; i++){
+        if(strcmp(argv[i], "-p") == 0 && i+1 < argc) port = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-b") == 0 && i+1 < argc) address = argv[++i];
+        else { fprintf(stderr, "usage: %s [-p port] [-b address]\n", argv[0]); return 2; }
+    }
+
+    int bound = broker_start(address, port);
+    if(bound < 0){
+        perror("broker");
+        return 2;
+    }
+    printf("listening on %s:%d\n", address, bound);
+    broker_set_listener(print_message);
+
+    while(true) broker_poll(1000);
+}
@@ -0,0 +1,82 @@
+#include "net.h"
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+
+// net.h on posix sockets, for testing against a local broker. There's no
+// radio, so up and down don't do anything
+
+static int sock = -1;
+
+
+
+bool net_initialize(){
+    return true;
+}
+
+bool net_up(uint32_t timeout_ms){
+    (void)timeout_ms;
+    return true;
+}
+
+void net_down(){
+    net_close();
+}
+
+
+bool net_connect(const char* host, int port, uint32_t timeout_ms){
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if(inet_pton(AF_INET, host, &address.sin_addr) != 1) return false;
+
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if(sock < 0) return false;
+
+    // it's local, so a blocking connect is quick; only replies need a timeout
+    (void)timeout_ms;
+    if(connect(sock, (struct sockaddr*)&address, sizeof(address)) != 0){
+        net_close();
+        return false;
+    }
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return true;
+}
+
+
+int net_send(const uint8_t* data, int length){
+    int sent = 0;
+    while(sock >= 0 && sent < length){
+        ssize_t n = send(sock, data + sent, length - sent, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return -1;
+        sent += n;
+    }
+    return sock >= 0 ? sent : -1;
+}
+
+
+int net_receive(uint8_t* data, int length, uint32_t timeout_ms){
+    if(sock < 0) return -1;
+
+    struct pollfd p = {sock, POLLIN, 0};
+    int ready = poll(&p, 1, timeout_ms);
+    if(ready == 0) return 0;
+    if(ready < 0) return errno == EINTR ? 0 : -1;
+
+    ssize_t n = recv(sock, data, length, 0);
+    return n > 0 ? (int)n : -1;
+}
+
+
+void net_close(){
+    if(sock >= 0) close(sock);
+    sock = -1;
+}
@@ -0,0 +1,208 @@
+// Compares following a setback schedule as written against starting early
+// with the optimal start learner (see optimal_start.h), over simulated rooms
+// (see plant.h).
+//
+//   optimal_start_sim [-n rooms] [-d days] [-w warmup days] [-r seed]
+//
+// For each room it reports how far from the scheduled time the room got
+// up to the morning setting, the degree-minutes below the setting while it
+// should be warm, and the heater runtime. The first -w days aren't counted
+// so the learner has something to go on.
+//
+// Every setting change overrides a button press on the real thermostat, so
+// the exit code is 1 if a room's setting changed more than once per
+// schedule entry on any counted day.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "thermostat.h"
+#include "optimal_start.h"
+#include "plant.h"
+
+
+#define DEFAULT_ROOMS 20
+#define DEFAULT_DAYS 14
+#define DEFAULT_WARMUP 2
+#define DEFAULT_SEED 1
+
+#define SECONDS_PER_DAY 86400
+#define SENSE_SECONDS (SENSE_INTERVAL / 1000)
+#define ARRIVED 0.5             // degrees under the setting that counts as there
+#define WINDOW_START (2*3600 + 30*60)   // look for the morning arrival from here
+#define WINDOW_END (12*3600)
+
+// the same as the example in main.c
+static const struct schedule_entry schedule[] = {
+    {6*60 + 30, 700},
+    {22*60,     620},
+};
+#define SCHEDULE_COUNT ((int)(sizeof(schedule) / sizeof(schedule[0])))
+#define MORNING (schedule[0].minute * 60)
+
+
+struct result {
+    double arrival_error_sum;       // minutes, late positive
+    double arrival_abs_sum;
+    double worst_late;
+    int mornings;
+    double degree_minutes;
+    double heater_hours;
+    int days;
+    int heating_rate;
+    int cooling_rate;
+    int setting_changes;
+    int most_changes;               // on one day
+};
+
+
+// starting at the night setting
+static struct plant make_room(uint64_t seed, int index){
+    uint64_t random = seed ^ (uint64_t)(index + 1) * 0x2545F4914F6CDD1Dull;
+    struct plant p;
+    plant_random_room(&p, &random);
+    p.temperature = schedule[SCHEDULE_COUNT-1].setting / 10.0;
+    return p;
+}
+
+
+static struct result run_room(struct plant p, int days, int warmup, bool optimal){
+    struct thermostat t;
+    struct result r = {0};
+    int applied = 0;
+    int changes_today = 0;
+    bool arrived = false;
+
+    plant_thermostat_initialize(&t, schedule[SCHEDULE_COUNT-1].setting);
+
+    for(long second=0; second < (long)days * SECONDS_PER_DAY; second++){
+        int day = second / SECONDS_PER_DAY;
+        uint32_t second_of_day = second % SECONDS_PER_DAY;
+        bool counted = day >= warmup;
+        if(second_of_day == 0) changes_today = 0;
+
+        if(second % SENSE_SECONDS == 0) plant_sense(&p, &t);
+
+        // what the relay task does every tick
+        int temperature = thermostat_get_temperature(&t);
+        optimal_start_update(&t.model, second * 1000, temperature, t.relay_state);
+        int setting = optimal
+            ? optimal_start_setting(&t.model, schedule, SCHEDULE_COUNT, second_of_day, temperature)
+            : optimal_start_schedule_setting(schedule, SCHEDULE_COUNT, second_of_day);
+        if(setting != applied){
+            applied = setting;
+            thermostat_set_setting(&t, setting);
+            if(counted){
+                r.setting_changes++;
+                if(++changes_today > r.most_changes) r.most_changes = changes_today;
+            }
+        }
+        int relay = thermostat_update_relay(&t);
+        plant_step(&p, relay == ON, 1);
+
+        if(!counted) continue;
+
+        // when the room got to the morning setting
+        double wanted = schedule[0].setting / 10.0;
+        if(second_of_day == WINDOW_START) arrived = p.temperature >= wanted - ARRIVED;
+        if(second_of_day == WINDOW_START && arrived){
+            // never cooled enough to need heating, so it's on time
+            r.mornings++;
+        }
+        else if(!arrived && second_of_day > WINDOW_START && second_of_day < WINDOW_END
+                && p.temperature >= wanted - ARRIVED){
+            arrived = true;
+            double error = ((double)second_of_day - MORNING) / 60;
+            r.arrival_error_sum += error;
+            r.arrival_abs_sum += fabs(error);
+            if(error > r.worst_late) r.worst_late = error;
+            r.mornings++;
+        }
+
+        // comfort is judged against the schedule as written
+        double scheduled = optimal_start_schedule_setting(schedule, SCHEDULE_COUNT, second_of_day) / 10.0;
+        if(p.temperature < scheduled - ARRIVED)
+            r.degree_minutes += (scheduled - ARRIVED - p.temperature) / 60;
+        if(relay == ON) r.heater_hours += 1.0 / 3600;
+    }
+
+    r.days = days - warmup;
+    r.heating_rate = t.model.heating_rate;
+    r.cooling_rate = t.model.cooling_rate;
+    return r;
+}
+
+
+
+int main(int argc, char** argv){
+
+    int rooms = DEFAULT_ROOMS;
+    int days = DEFAULT_DAYS;
+    int warmup = DEFAULT_WARMUP;
+    uint64_t seed = DEFAULT_SEED;
+
+    for(int i=1; i<argc; i++){
+        if(i+1 >= argc){
+            fprintf(stderr, "usage: %s [-n rooms] [-d days] [-w warmup days] [-r seed]\n", argv[0]);
+            return 2;
+        }
+        if(strcmp(argv[i], "-n") == 0) rooms = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-d") == 0) days = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-w") == 0) warmup = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-r") == 0) seed = strtoull(argv[++i], NULL, 10);
+        else { fprintf(stderr, "unknown option %s\n", argv[i]); return 2; }
+    }
+    if(rooms < 1 || days <= warmup){
+        fprintf(stderr, "need at least one room and more days than warmup days\n");
+        return 2;
+    }
+
+    printf("%d rooms, %d days, first %d not counted\n", rooms, days, warmup);
+    printf("%4s %6s %6s | %9s %9s %8s %9s | %9s %9s %8s %9s %7s\n", "", "learned", "",
+            "schedule", "", "", "", "optimal", "", "", "", "");
+    printf("%4s %6s %6s | %9s %9s %8s %9s | %9s %9s %8s %9s %7s\n", "room", "heat", "cool",
+            "late min", "worst", "deg-min", "heat h/d", "late min", "worst", "deg-min", "heat h/d",
+            "changes");
+
+    struct result total[2] = {{0}};
+    int too_many_changes = 0;
+    for(int i=0; i<rooms; i++){
+        struct plant room = make_room(seed, i);
+        struct result plain = run_room(room, days, warmup, false);
+        struct result optimal = run_room(room, days, warmup, true);
+
+        printf("%4d %6.1f %6.1f | %9.1f %9.1f %8.0f %9.2f | %9.1f %9.1f %8.0f %9.2f %7.1f\n", i,
+                optimal.heating_rate / 10.0, optimal.cooling_rate / 10.0,
+                plain.arrival_abs_sum / plain.mornings, plain.worst_late,
+                plain.degree_minutes / plain.days, plain.heater_hours / plain.days,
+                optimal.arrival_abs_sum / optimal.mornings, optimal.worst_late,
+                optimal.degree_minutes / optimal.days, optimal.heater_hours / optimal.days,
+                (double)optimal.setting_changes / optimal.days);
+        if(plain.most_changes > SCHEDULE_COUNT || optimal.most_changes > SCHEDULE_COUNT)
+            too_many_changes++;
+
+        struct result* both[2] = {&plain, &optimal};
+        for(int k=0; k<2; k++){
+            total[k].arrival_abs_sum += both[k]->arrival_abs_sum;
+            total[k].arrival_error_sum += both[k]->arrival_error_sum;
+            total[k].mornings += both[k]->mornings;
+            total[k].degree_minutes += both[k]->degree_minutes;
+            total[k].heater_hours += both[k]->heater_hours;
+            total[k].days += both[k]->days;
+            if(both[k]->worst_late > total[k].worst_late) total[k].worst_late = both[k]->worst_late;
+        }
+    }
+
+    const char* names[2] = {"schedule", "optimal"};
+    printf("\n");
+    for(int k=0; k<2; k++){
+        printf("%-9s mean |arrival error| %5.1f min (mean %+5.1f, worst late %5.1f), "
+               "%6.1f degree-minutes/day below setting, heater %5.2f h/day\n", names[k],
+                total[k].arrival_abs_sum / total[k].mornings,
+                total[k].arrival_error_sum / total[k].mornings, total[k].worst_late,
+                total[k].degree_minutes / total[k].days, total[k].heater_hours / total[k].days);
+    }
+    printf("%d rooms changed setting more than %d times in a day\n", too_many_changes, SCHEDULE_COUNT);
+    return too_many_changes ? 1 : 0;
+}
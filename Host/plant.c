@@ -0,0 +1,86 @@
+#include "plant.h"
+#include "thermostat.h"
+#include "host_i2c.h"
+#include <math.h>
+
+
+#define SECONDS_PER_HOUR 3600.0
+#define SECONDS_PER_DAY 86400.0
+#define AHT20_SCALE 1048576.0   // 2^20
+
+
+
+// coldest at 4am, warmest at 4pm
+double plant_outdoor_temperature(const struct plant* p){
+    double day_fraction = fmod(p->time, SECONDS_PER_DAY) / SECONDS_PER_DAY;
+    return p->outdoor - p->outdoor_swing * cos(2 * M_PI * (day_fraction - 4.0/24));
+}
+
+
+void plant_step(struct plant* p, bool heating, double seconds){
+    double hours = seconds / SECONDS_PER_HOUR;
+    double loss = (p->temperature - plant_outdoor_temperature(p)) / p->time_constant;
+    double gain = heating ? p->heating_rate : 0;
+
+    p->temperature += (gain - loss) * hours;
+    p->time += seconds;
+}
+
+
+// the reverse of aht20_read_measurement()
+void plant_aht20_frame(const struct plant* p, uint8_t* frame){
+    double celsius = (p->temperature - 32) * 5 / 9;
+    unsigned long temp = (unsigned long)((celsius + 50) / 200 * AHT20_SCALE + 0.5) & 0xFFFFF;
+    unsigned long humi = (unsigned long)(p->humidity / 100 * AHT20_SCALE + 0.5) & 0xFFFFF;
+
+    frame[0] = 0x1C;    // status: calibrated, not busy
+    frame[1] = humi >> 12;
+    frame[2] = humi >> 4;
+    frame[3] = ((humi & 0x0F) << 4) | (temp >> 16);
+    frame[4] = temp >> 8;
+    frame[5] = temp;
+}
+
+
+
+uint64_t plant_random_next(uint64_t* state){
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+double plant_random_between(uint64_t* state, double low, double high){
+    return low + (high - low) * (plant_random_next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+void plant_random_room(struct plant* p, uint64_t* random){
+    p->outdoor = plant_random_between(random, 20, 50);
+    p->outdoor_swing = plant_random_between(random, 3, 12);
+    p->time_constant = plant_random_between(random, 5, 30);
+    p->heating_rate = plant_random_between(random, 6, 20);
+    p->humidity = plant_random_between(random, 25, 60);
+    p->temperature = plant_random_between(random, 60, 72);
+    p->time = 0;
+}
+
+
+
+void plant_thermostat_initialize(struct thermostat* t, int setting){
+    host_i2c_reset();
+    thermostat_initialize(t, setting);
+    aht20_initialize(&t->sensor);
+}
+
+
+bool plant_sense(const struct plant* p, struct thermostat* t){
+    uint8_t frame[AHT20_FRAME_LENGTH];
+    plant_aht20_frame(p, frame);
+    host_i2c_set_aht20_frame(frame);
+
+    if(!aht20_start_measurement(&t->sensor) || !aht20_read_measurement(&t->sensor))
+        return false;
+    thermostat_new_reading(t);
+    return true;
+}
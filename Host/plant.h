@@ -0,0 +1,53 @@
+#ifndef PLANT_H
+#define PLANT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct thermostat;
+
+
+// Very simple thermal model of a room, for simulations. The room loses
+// heat to the outside in proportion to the temperature difference, and
+// the heater adds a fixed number of degrees per hour while the relay is on.
+// Temperatures are in degrees F like the rest of the firmware.
+
+struct plant {
+    double temperature;     // indoor
+    double outdoor;         // daily mean outdoor temperature
+    double outdoor_swing;   // outdoor goes this far above and below the mean
+    double time_constant;   // hours for the room to drift 63% of the way to outdoor
+    double heating_rate;    // degrees per hour the heater adds
+    double humidity;        // percent
+    double time;            // seconds since the start
+};
+
+
+void plant_step(struct plant* p, bool heating, double seconds);
+
+double plant_outdoor_temperature(const struct plant* p);
+
+// the 6 bytes an aht20 would send for the current room temperature
+void plant_aht20_frame(const struct plant* p, uint8_t* frame);
+
+// splitmix64, so a simulation only depends on its seed and is the same on
+// every machine
+uint64_t plant_random_next(uint64_t* state);
+
+double plant_random_between(uint64_t* state, double low, double high);
+
+// a room picked at random from typical ones: 20-50F outside, swinging
+// 3-12F over the day, a heater that can manage 6-20F an hour, and between
+// 60 and 72F inside to start with. time is 0
+void plant_random_room(struct plant* p, uint64_t* random);
+
+// a thermostat with its sensor on a fresh fake i2c bus (this thread's, see
+// host_i2c.h), the way the simulations start one
+void plant_thermostat_initialize(struct thermostat* t, int setting);
+
+// what the sensor task does with the room as it is now: trigger the aht20,
+// read it and average the reading in. Returns false if it didn't answer
+bool plant_sense(const struct plant* p, struct thermostat* t);
+
+
+#endif
@@ -0,0 +1,356 @@
+// Replays a serial log recorded by the firmware (see recorder.h) through the
+// real aht20, circular_buffer, seven_seg, thermostat and ui code, as fast as
+// the PC can go.
+//
+//   replay <trace> [-o output] [-g golden] [-s setting]
+//
+// The relay changes and display updates from the replay are written in the
+// same @ line format. With -g they are compared against an earlier run and
+// the exit code is 1 if anything is different.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "aht20.h"
+#include "i2c_module.h"
+#include "seven_seg.h"
+#include "thermostat.h"
+#include "ui.h"
+#include "recorder.h"
+#include "host_i2c.h"
+
+
+#define LINE_LENGTH 128
+#define DEFAULT_SETTING 700
+
+
+struct record {
+    unsigned long time;
+    char type;
+    char button;
+    int relay;
+    int setting;
+    uint8_t frame[AHT20_FRAME_LENGTH];
+};
+
+// grows as needed
+struct record_list {
+    struct record* records;
+    int count;
+    int capacity;
+};
+
+struct line_list {
+    char** lines;
+    int count;
+    int capacity;
+};
+
+
+static struct line_list output;
+static struct record_list recorded_relay;
+static struct record_list replay_relay;
+static struct thermostat thermostat;
+
+
+
+/*****************************************************/
+/****************** Helper Functions *****************/
+/*****************************************************/
+
+static void add_record(struct record_list* list, const struct record* r){
+    if(list->count == list->capacity){
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->records = realloc(list->records, list->capacity * sizeof(struct record));
+        if(!list->records){ perror("realloc"); exit(2); }
+    }
+    list->records[list->count++] = *r;
+}
+
+static void add_line(struct line_list* list, const char* line){
+    if(list->count == list->capacity){
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->lines = realloc(list->lines, list->capacity * sizeof(char*));
+        if(!list->lines){ perror("realloc"); exit(2); }
+    }
+    list->lines[list->count++] = strdup(line);
+}
+
+
+// parse one "@<ms> <type> <data>" line. returns 0 if it isn't a record
+static int parse_record(const char* line, struct record* r){
+    char data[LINE_LENGTH];
+
+    if(line[0] != RECORD_PREFIX) return 0;
+    if(sscanf(line + 1, "%lu %c %127s", &r->time, &r->type, data) != 3) return 0;
+
+    if(r->type == RECORD_AHT20){
+        if(strlen(data) != AHT20_FRAME_LENGTH * 2) return 0;
+        for(int i=0; i<AHT20_FRAME_LENGTH; i++){
+            unsigned int byte;
+            if(sscanf(data + i*2, "%2x", &byte) != 1) return 0;
+            r->frame[i] = byte;
+        }
+    }
+    else if(r->type == RECORD_BUTTON){
+        r->button = data[0];
+    }
+    else if(r->type == RECORD_RELAY){
+        r->relay = atoi(data);
+    }
+    else if(r->type == RECORD_SETTING){
+        r->setting = atoi(data);
+    }
+    else {
+        return 0;
+    }
+    return 1;
+}
+
+
+static int read_trace(const char* path, struct record_list* list){
+    FILE* f = fopen(path, "r");
+    if(!f){ perror(path); return -1; }
+
+    char line[LINE_LENGTH];
+    struct record r;
+    while(fgets(line, sizeof(line), f)){
+        if(parse_record(line, &r))
+            add_record(list, &r);
+    }
+    fclose(f);
+
+    // tasks can be preempted between taking the timestamp and printing, so
+    // lines can be slightly out of order. insertion sort, since it's almost
+    // sorted already and this keeps records with the same time in order
+    for(int i=1; i<list->count; i++){
+        r = list->records[i];
+        int j = i;
+        while(j > 0 && list->records[j-1].time > r.time){
+            list->records[j] = list->records[j-1];
+            j--;
+        }
+        list->records[j] = r;
+    }
+    return list->count;
+}
+
+
+static int read_lines(const char* path, struct line_list* list){
+    FILE* f = fopen(path, "r");
+    if(!f){ perror(path); return -1; }
+
+    char line[LINE_LENGTH];
+    while(fgets(line, sizeof(line), f)){
+        line[strcspn(line, "\r\n")] = 0;
+        add_line(list, line);
+    }
+    fclose(f);
+    return list->count;
+}
+
+
+
+/*****************************************************/
+/****************** Simulation ***********************/
+/*****************************************************/
+
+static void emit_display(unsigned long now){
+    if(!host_i2c_display_changed()) return;
+
+    uint8_t digits[HOST_DISPLAY_DIGITS];
+    bool on = host_i2c_get_display(digits);
+
+    char line[LINE_LENGTH];
+    int n = snprintf(line, sizeof(line), "%c%lu %c %d ", RECORD_PREFIX, now, RECORD_DISPLAY, on);
+    for(int i=0; i<HOST_DISPLAY_DIGITS; i++){
+        n += snprintf(line + n, sizeof(line) - n, "%02x", digits[i]);
+    }
+    add_line(&output, line);
+}
+
+
+static void emit_relay(unsigned long now, int relay_state){
+    char line[LINE_LENGTH];
+    snprintf(line, sizeof(line), "%c%lu %c %d", RECORD_PREFIX, now, RECORD_RELAY, relay_state);
+    add_line(&output, line);
+
+    struct record r = { .time = now, .type = RECORD_RELAY, .relay = relay_state };
+    add_record(&replay_relay, &r);
+}
+
+
+// what the ui and display tasks do on the pico, done straight away.
+// returns true if the screen timeout should be started
+static bool send_ui_event(enum ui_event event, unsigned long now){
+    struct ui_message message = {event, now};
+    struct display_request request;
+    bool start_timeout = ui_handle_event(&thermostat, &message, &request);
+    ui_show(&thermostat.display, &request);
+    return start_timeout;
+}
+
+
+// Plays the records in order. The relay task and the screen timeout timer
+// are run at the times they would have fired on the pico.
+static void replay(const struct record_list* trace, int setting){
+
+    unsigned long next_relay_tick = 0;
+    unsigned long timeout_at = 0;
+    bool timeout_running = false;
+    int relay_state = OFF;
+
+    i2c_module_initialize();
+    thermostat_initialize(&thermostat, setting);
+    seven_seg_begin(&thermostat.display);
+    aht20_initialize(&thermostat.sensor);
+
+    for(int i=0; i<trace->count; i++){
+        const struct record* r = &trace->records[i];
+
+        // catch up on everything that would have happened before this record
+        while(next_relay_tick <= r->time || (timeout_running && timeout_at <= r->time)){
+            if(timeout_running && timeout_at <= next_relay_tick){
+                timeout_running = false;
+                send_ui_event(UI_EVENT_TIMEOUT, timeout_at);
+                emit_display(timeout_at);
+                continue;
+            }
+            int new_state = thermostat_update_relay(&thermostat);
+            if(new_state != relay_state){
+                relay_state = new_state;
+                emit_relay(next_relay_tick, relay_state);
+            }
+            next_relay_tick += RELAY_INTERVAL;
+        }
+
+        if(r->type == RECORD_AHT20){
+            host_i2c_set_aht20_frame(r->frame);
+            aht20_start_measurement(&thermostat.sensor);
+            aht20_read_measurement(&thermostat.sensor);
+            thermostat_new_reading(&thermostat);
+            send_ui_event(UI_EVENT_SAMPLE, r->time);
+        }
+        else if(r->type == RECORD_BUTTON){
+            enum ui_event event = r->button == BUTTON_UP ? UI_EVENT_UP
+                                : r->button == BUTTON_DOWN ? UI_EVENT_DOWN
+                                : UI_EVENT_CYCLE;
+            if(send_ui_event(event, r->time)){
+                timeout_running = true;
+                timeout_at = r->time + SET_TEMP_TIMEOUT_TIME;
+            }
+        }
+        else if(r->type == RECORD_RELAY){
+            add_record(&recorded_relay, r);
+        }
+        else if(r->type == RECORD_SETTING){
+            // the schedule or the network, not the buttons
+            thermostat_set_setting(&thermostat, r->setting);
+        }
+        emit_display(r->time);
+    }
+}
+
+
+// every relay change the pico recorded should show up in the replay
+// within a couple of relay intervals, since the tasks won't line up exactly
+static int check_recorded_relay(){
+    int mismatches = 0;
+    for(int i=0; i<recorded_relay.count; i++){
+        const struct record* want = &recorded_relay.records[i];
+        bool found = false;
+        for(int j=0; j<replay_relay.count && !found; j++){
+            const struct record* got = &replay_relay.records[j];
+            long diff = (long)got->time - (long)want->time;
+            if(got->relay == want->relay && labs(diff) <= 2 * RELAY_INTERVAL)
+                found = true;
+        }
+        if(!found){
+            printf("recorded relay %d at %lu ms not reproduced\n", want->relay, want->time);
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+
+static int compare_golden(const char* path){
+    struct line_list golden = {0};
+    if(read_lines(path, &golden) < 0) return -1;
+
+    int differences = 0;
+    int count = output.count > golden.count ? output.count : golden.count;
+    for(int i=0; i<count; i++){
+        const char* got = i < output.count ? output.lines[i] : "(nothing)";
+        const char* want = i < golden.count ? golden.lines[i] : "(nothing)";
+        if(strcmp(got, want) != 0){
+            if(differences < 10)
+                printf("line %d: expected \"%s\", got \"%s\"\n", i+1, want, got);
+            differences++;
+        }
+    }
+    return differences;
+}
+
+
+
+int main(int argc, char** argv){
+
+    const char* trace_path = NULL;
+    const char* output_path = NULL;
+    const char* golden_path = NULL;
+    int setting = DEFAULT_SETTING;
+
+    for(int i=1; i<argc; i++){
+        if(strcmp(argv[i], "-o") == 0 && i+1 < argc) output_path = argv[++i];
+        else if(strcmp(argv[i], "-g") == 0 && i+1 < argc) golden_path = argv[++i];
+        else if(strcmp(argv[i], "-s") == 0 && i+1 < argc) setting = atoi(argv[++i]);
+        else if(!trace_path) trace_path = argv[i];
+        else trace_path = NULL, i = argc;
+    }
+    if(!trace_path){
+        fprintf(stderr, "usage: %s <trace> [-o output] [-g golden] [-s setting]\n", argv[0]);
+        return 2;
+    }
+
+    struct record_list trace = {0};
+    if(read_trace(trace_path, &trace) <= 0){
+        fprintf(stderr, "no records in %s\n", trace_path);
+        return 2;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    replay(&trace, setting);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double wall_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    double sim_ms = trace.records[trace.count-1].time;
+    printf("replayed %d records, %.1f hours in %.2f ms (%.0fx real time)\n",
+            trace.count, sim_ms / 3.6e6, wall_ms, wall_ms > 0 ? sim_ms / wall_ms : 0);
+
+    if(output_path){
+        FILE* f = fopen(output_path, "w");
+        if(!f){ perror(output_path); return 2; }
+        for(int i=0; i<output.count; i++)
+            fprintf(f, "%s\n", output.lines[i]);
+        fclose(f);
+    }
+
+    int failed = 0;
+    if(recorded_relay.count){
+        int mismatches = check_recorded_relay();
+        printf("%d of %d recorded relay changes reproduced\n",
+                recorded_relay.count - mismatches, recorded_relay.count);
+        failed |= mismatches != 0;
+    }
+    if(golden_path){
+        int differences = compare_golden(golden_path);
+        if(differences < 0) return 2;
+        printf("%d lines differ from %s\n", differences, golden_path);
+        failed |= differences != 0;
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,216 @@
+// Runs a thermostat against a simulated room (see plant.h) for a while,
+// sending telemetry through the real mqtt and telemetry code to the
+// stand-in broker (broker.h) over a local socket. Checks that every
+// sample arrives exactly as it was taken, and that a setting published
+// to the broker is picked up and cleared.
+//
+//   telemetry_sim [-h hours] [-c hour to send a setting] [-s setting] [-r seed]
+//
+// The exit code is 1 if anything didn't make it through.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include "thermostat.h"
+#include "telemetry.h"
+#include "net.h"
+#include "plant.h"
+#include "broker.h"
+
+
+#define DEFAULT_HOURS 24
+#define DEFAULT_CHANGE_HOUR 6
+#define DEFAULT_REMOTE_SETTING 680
+#define DEFAULT_SEED 1
+#define HOST "127.0.0.1"
+#define SENSE_SECONDS (SENSE_INTERVAL / 1000)
+#define SETTLE_MS 2000      // how long to wait for the broker to catch up at the end
+
+// roughly what a naive client would send for one sample, one message each,
+// e.g. {"time":86390,"temperature":701,"humidity":45,"setting":700,"relay":1}
+#define NAIVE_JSON_BYTES 72
+#define MQTT_PUBLISH_OVERHEAD (2 + 2 + sizeof(TELEMETRY_TOPIC) - 1)
+
+
+struct sample_list {
+    struct telemetry_sample* samples;
+    int count;
+    int capacity;
+};
+
+
+static struct sample_list expected;
+static struct sample_list received;
+static pthread_mutex_t received_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_bool stopping = false;
+static struct telemetry telemetry;
+
+
+
+static void add_sample(struct sample_list* list, const struct telemetry_sample* s){
+    if(list->count == list->capacity){
+        list->capacity = list->capacity ? list->capacity * 2 : 1024;
+        list->samples = realloc(list->samples, list->capacity * sizeof(struct telemetry_sample));
+        if(!list->samples){ perror("realloc"); exit(2); }
+    }
+    list->samples[list->count++] = *s;
+}
+
+
+// on the broker's thread
+static void on_publish(const char* topic, const uint8_t* payload, int length, bool retain){
+    (void)retain;
+    if(strcmp(topic, TELEMETRY_TOPIC) != 0) return;
+
+    struct telemetry_sample batch[TELEMETRY_PAYLOAD];
+    int count = telemetry_decode((const char*)payload, length, batch, TELEMETRY_PAYLOAD);
+    pthread_mutex_lock(&received_lock);
+    for(int i=0; i<count; i++) add_sample(&received, &batch[i]);
+    pthread_mutex_unlock(&received_lock);
+}
+
+static void* broker_thread(void* arg){
+    (void)arg;
+    while(!atomic_load(&stopping)) broker_poll(20);
+    return NULL;
+}
+
+
+static double now_ms(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+static bool same_sample(const struct telemetry_sample* a, const struct telemetry_sample* b){
+    return a->time == b->time && a->temperature == b->temperature && a->humidity == b->humidity
+        && a->setting == b->setting && a->relay == b->relay;
+}
+
+
+
+int main(int argc, char** argv){
+
+    int hours = DEFAULT_HOURS;
+    int change_hour = DEFAULT_CHANGE_HOUR;
+    int remote_setting = DEFAULT_REMOTE_SETTING;
+    uint64_t seed = DEFAULT_SEED;
+
+    for(int i=1; i<argc; i++){
+        if(i+1 >= argc){
+            fprintf(stderr, "usage: %s [-h hours] [-c hour to send a setting] [-s setting] [-r seed]\n", argv[0]);
+            return 2;
+        }
+        if(strcmp(argv[i], "-h") == 0) hours = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-c") == 0) change_hour = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-s") == 0) remote_setting = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-r") == 0) seed = strtoull(argv[++i], NULL, 10);
+        else { fprintf(stderr, "unknown option %s\n", argv[i]); return 2; }
+    }
+
+    int port = broker_start("127.0.0.1", 0);
+    if(port < 0){ perror("broker"); return 2; }
+    broker_set_listener(on_publish);
+    pthread_t thread;
+    pthread_create(&thread, NULL, broker_thread, NULL);
+
+    // a room that needs heating now and then
+    struct plant room = {0};
+    room.outdoor = 30 + (seed % 20);
+    room.outdoor_swing = 8;
+    room.time_constant = 12;
+    room.heating_rate = 12;
+    room.humidity = 40;
+    room.temperature = 68;
+
+    struct thermostat t;
+    plant_thermostat_initialize(&t, 700);
+    net_initialize();
+    telemetry_initialize(&telemetry, SENSE_SECONDS);
+
+    bool setting_sent = false;
+    long applied_at = -1;
+    double connected_ms = 0;
+    int failed = 0;
+
+    for(long second=0; second < (long)hours * 3600; second++){
+        if(!setting_sent && second >= (long)change_hour * 3600){
+            char text[16];
+            int length = snprintf(text, sizeof(text), "%d", remote_setting);
+            broker_publish(TELEMETRY_SETTING_TOPIC, (const uint8_t*)text, length, true);
+            setting_sent = true;
+        }
+
+        if(second % SENSE_SECONDS == 0){
+            plant_sense(&room, &t);
+
+            // what the telemetry task does with each reading
+            struct telemetry_sample s = {second, thermostat_get_temperature(&t),
+                thermostat_get_humidity(&t), thermostat_get_setting(&t), t.relay_state};
+            add_sample(&expected, &s);
+            if(telemetry_add(&telemetry, &s)){
+                double start = now_ms();
+                int setting = telemetry_send(&telemetry, HOST, port);
+                connected_ms += now_ms() - start;
+                if(setting){
+                    thermostat_set_setting(&t, setting);
+                    if(applied_at < 0) applied_at = second;
+                }
+            }
+        }
+
+        int relay = thermostat_update_relay(&t);
+        plant_step(&room, relay == ON, 1);
+    }
+    if(telemetry.count > 0) telemetry_send(&telemetry, HOST, port);
+
+    // the last batch may still be on its way through the broker
+    double deadline = now_ms() + SETTLE_MS;
+    while(now_ms() < deadline){
+        pthread_mutex_lock(&received_lock);
+        int count = received.count;
+        pthread_mutex_unlock(&received_lock);
+        if(count >= expected.count) break;
+        usleep(1000);
+    }
+    atomic_store(&stopping, true);
+    pthread_join(thread, NULL);
+
+    int mismatches = 0;
+    for(int i=0; i<expected.count && i<received.count; i++){
+        if(!same_sample(&expected.samples[i], &received.samples[i])){
+            if(mismatches < 5) printf("sample %d at %lus differs\n", i, (unsigned long)expected.samples[i].time);
+            mismatches++;
+        }
+    }
+    if(received.count != expected.count || mismatches){
+        printf("%d of %d samples arrived, %d differ\n", received.count, expected.count, mismatches);
+        failed = 1;
+    }
+
+    uint8_t retained[16];
+    bool cleared = broker_get_retained(TELEMETRY_SETTING_TOPIC, retained, sizeof(retained)) < 0;
+    if(setting_sent && (applied_at < 0 || thermostat_get_setting(&t) != remote_setting || !cleared)){
+        printf("remote setting %d wasn't applied and cleared\n", remote_setting);
+        failed = 1;
+    }
+    broker_stop();
+
+    double naive = (double)expected.count * (NAIVE_JSON_BYTES + MQTT_PUBLISH_OVERHEAD);
+    printf("%d hours: %d samples in %lu wake ups (%.1f per hour)\n", hours, expected.count,
+            (unsigned long)telemetry.wakes, (double)telemetry.wakes / hours);
+    printf("%lu payload bytes, %.1f per sample; one json message per sample would be about %.0f (%.0fx)\n",
+            (unsigned long)telemetry.bytes_sent, (double)telemetry.bytes_sent / expected.count,
+            naive, naive / (telemetry.bytes_sent ? telemetry.bytes_sent : 1));
+    printf("%.2f ms connected per wake up on localhost\n", connected_ms / telemetry.wakes);
+    if(setting_sent && applied_at >= 0)
+        printf("setting %d sent at %d:00, applied %.1f minutes later\n", remote_setting, change_hour,
+                (applied_at - change_hour * 3600L) / 60.0);
+    printf("%d of %d samples arrived intact\n", received.count - mismatches, expected.count);
+
+    return failed;
+}
@@ -0,0 +1,249 @@
+// Converts a trace dump from the pico (the "trace" console command, see
+// ProjectFiles/trace.h) into Chrome trace event JSON, which opens in
+// chrome://tracing or ui.perfetto.dev.
+//
+//   trace2perfetto <serial log> [output.json]
+//
+// Each task gets a track showing when it was running, with instant markers
+// where it delayed or blocked on a queue. Each i2c device gets a track on
+// the "i2c" process showing its transactions and which task started them.
+// Only the last dump in the log is used.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#define LINE_LENGTH 128
+#define MAX_TASKS 16
+#define NAME_LENGTH 16
+#define I2C_ADDRESSES 128
+#define PID_TASKS 1
+#define PID_I2C 2
+
+// must match trace.h. Not included directly since it needs FreeRTOS
+#define TRACE_TASK_CREATE       0x01
+#define TRACE_TASK_IN           0x02
+#define TRACE_TASK_OUT          0x03
+#define TRACE_TASK_DELAY        0x04
+#define TRACE_QUEUE_RECEIVE     0x05
+#define TRACE_QUEUE_SEND        0x06
+#define TRACE_I2C_START         0x10
+#define TRACE_I2C_END           0x11
+#define TRACE_I2C_READ 0x8000
+
+
+struct record {
+    uint64_t time;      // unwrapped, microseconds
+    int type;
+    int id;
+    int arg;
+};
+
+struct i2c_transaction {
+    bool active;
+    uint64_t start;
+    int length;
+    bool read;
+    int task;
+};
+
+
+static char task_names[MAX_TASKS][NAME_LENGTH];
+static struct record* records = NULL;
+static int record_count = 0;
+static int first_event = 1;
+
+
+
+static const char* task_name(int task){
+    static char unknown[NAME_LENGTH];
+    if(task >= 0 && task < MAX_TASKS && task_names[task][0]) return task_names[task];
+    snprintf(unknown, sizeof(unknown), "task %d", task);
+    return unknown;
+}
+
+static void event_separator(FILE* out){
+    if(!first_event) fprintf(out, ",\n");
+    first_event = 0;
+}
+
+
+// reads the last complete dump in the log. returns the number of records
+static int read_dump(FILE* in){
+    char line[LINE_LENGTH];
+    int capacity = 0;
+    uint64_t high = 0;
+    uint32_t last = 0;
+
+    while(fgets(line, sizeof(line), in)){
+        unsigned long count, overwritten;
+        unsigned long time;
+        unsigned int type, id, arg;
+        int task;
+        char name[NAME_LENGTH];
+
+        if(sscanf(line, "$trace begin %lu %lu", &count, &overwritten) == 2){
+            // start again, so we end up with the last dump
+            record_count = 0;
+            high = 0;
+            last = 0;
+            memset(task_names, 0, sizeof(task_names));
+        }
+        else if(sscanf(line, "$task %d %15s", &task, name) == 2){
+            if(task >= 0 && task < MAX_TASKS) strcpy(task_names[task], name);
+        }
+        else if(sscanf(line, "$r %lx %x %x %x", &time, &type, &id, &arg) == 4){
+            if(record_count == capacity){
+                capacity = capacity ? capacity * 2 : 1024;
+                records = realloc(records, capacity * sizeof(struct record));
+                if(!records){ perror("realloc"); exit(2); }
+            }
+            // the pico's timestamp is 32 bits and wraps every ~71 minutes
+            if(record_count > 0 && (uint32_t)time < last) high += 1ull << 32;
+            last = time;
+
+            struct record* r = &records[record_count++];
+            r->time = high | (uint32_t)time;
+            r->type = type;
+            r->id = id;
+            r->arg = arg;
+        }
+    }
+    return record_count;
+}
+
+
+static void write_trace(FILE* out){
+    uint64_t origin = records[0].time;
+    uint64_t running_since[MAX_TASKS] = {0};
+    bool running[MAX_TASKS] = {false};
+    struct i2c_transaction i2c[I2C_ADDRESSES] = {{0}};
+    bool named[I2C_ADDRESSES] = {false};
+    int current_task = -1;
+
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+    event_separator(out);
+    fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"tasks\"}}", PID_TASKS);
+    event_separator(out);
+    fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"i2c\"}}", PID_I2C);
+    for(int i=0; i<MAX_TASKS; i++){
+        if(!task_names[i][0]) continue;
+        event_separator(out);
+        fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                PID_TASKS, i, task_names[i]);
+    }
+
+    for(int i=0; i<record_count; i++){
+        const struct record* r = &records[i];
+        uint64_t ts = r->time - origin;
+        int task = r->id;
+
+        switch(r->type){
+        case TRACE_TASK_IN:
+            if(task < MAX_TASKS){
+                running[task] = true;
+                running_since[task] = ts;
+            }
+            current_task = task;
+            break;
+
+        case TRACE_TASK_OUT:
+            if(task < MAX_TASKS && running[task]){
+                running[task] = false;
+                event_separator(out);
+                fprintf(out, "{\"name\": \"running\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, \"ts\": %llu, \"dur\": %llu}",
+                        PID_TASKS, task, (unsigned long long)running_since[task],
+                        (unsigned long long)(ts - running_since[task]));
+            }
+            break;
+
+        case TRACE_TASK_DELAY:
+        case TRACE_QUEUE_RECEIVE:
+        case TRACE_QUEUE_SEND:
+            event_separator(out);
+            fprintf(out, "{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"t\", \"pid\": %d, \"tid\": %d, \"ts\": %llu}",
+                    r->type == TRACE_TASK_DELAY ? "delay" :
+                    r->type == TRACE_QUEUE_RECEIVE ? "wait queue" : "queue full",
+                    PID_TASKS, task, (unsigned long long)ts);
+            break;
+
+        case TRACE_TASK_CREATE:
+            event_separator(out);
+            fprintf(out, "{\"name\": \"created\", \"ph\": \"i\", \"s\": \"t\", \"pid\": %d, \"tid\": %d, \"ts\": %llu}",
+                    PID_TASKS, task, (unsigned long long)ts);
+            break;
+
+        case TRACE_I2C_START:
+            if(r->id < I2C_ADDRESSES){
+                struct i2c_transaction* t = &i2c[r->id];
+                if(!named[r->id]){
+                    named[r->id] = true;
+                    event_separator(out);
+                    fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"0x%02x\"}}",
+                            PID_I2C, r->id, r->id);
+                }
+                // a start while one is already going means two tasks are
+                // fighting over the bus
+                if(t->active){
+                    event_separator(out);
+                    fprintf(out, "{\"name\": \"overlapping start\", \"ph\": \"i\", \"s\": \"t\", \"pid\": %d, \"tid\": %d, \"ts\": %llu}",
+                            PID_I2C, r->id, (unsigned long long)ts);
+                }
+                t->active = true;
+                t->start = ts;
+                t->length = r->arg & ~TRACE_I2C_READ;
+                t->read = r->arg & TRACE_I2C_READ;
+                t->task = current_task;
+            }
+            break;
+
+        case TRACE_I2C_END:
+            if(r->id < I2C_ADDRESSES && i2c[r->id].active){
+                struct i2c_transaction* t = &i2c[r->id];
+                t->active = false;
+                event_separator(out);
+                fprintf(out, "{\"name\": \"%s 0x%02x\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, \"ts\": %llu, \"dur\": %llu, "
+                        "\"args\": {\"task\": \"%s\", \"length\": %d, \"result\": %d}}",
+                        t->read ? "read" : "write", r->id, PID_I2C, r->id,
+                        (unsigned long long)t->start, (unsigned long long)(ts - t->start),
+                        task_name(t->task), t->length, (int16_t)r->arg);
+            }
+            break;
+        }
+    }
+
+    fprintf(out, "\n]}\n");
+}
+
+
+
+int main(int argc, char** argv){
+
+    if(argc < 2 || argc > 3){
+        fprintf(stderr, "usage: %s <serial log> [output.json]\n", argv[0]);
+        return 2;
+    }
+
+    FILE* in = fopen(argv[1], "r");
+    if(!in){ perror(argv[1]); return 2; }
+    read_dump(in);
+    fclose(in);
+
+    if(record_count == 0){
+        fprintf(stderr, "no trace records in %s\n", argv[1]);
+        return 1;
+    }
+
+    FILE* out = argc == 3 ? fopen(argv[2], "w") : stdout;
+    if(!out){ perror(argv[2]); return 2; }
+    write_trace(out);
+    if(out != stdout) fclose(out);
+
+    fprintf(stderr, "%d records, %.3f s\n", record_count,
+            (records[record_count-1].time - records[0].time) / 1e6);
+    return 0;
+}
@@ -0,0 +1,163 @@
+// Runs the zone scheduler over more and more zones, each with its own
+// simulated room (see plant.h), to check that relays never switch on
+// closer together than the stagger time and that a tick costs the same per
+// zone however many zones there are.
+//
+//   zone_sim [-z max zones] [-h hours] [-g stagger ms] [-r seed]
+//
+// Runs 1, 4, 16... zones up to -z. Only the scheduler tick is timed; the
+// rooms and sensor readings are just there to give it something realistic
+// to do. The exit code is 1 if two relays switched on too close together.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "thermostat.h"
+#include "zone_scheduler.h"
+#include "plant.h"
+
+
+#define DEFAULT_MAX_ZONES 1024
+#define DEFAULT_HOURS 24
+#define DEFAULT_SEED 1
+
+#define TICK_MS RELAY_INTERVAL
+#define SENSE_TICKS (SENSE_INTERVAL / RELAY_INTERVAL)
+
+
+struct result {
+    int zones;
+    double ns_per_zone;
+    int switch_ons;
+    int most_per_tick;
+    int biggest_burst;          // most zones starting to want heat in one tick
+    uint32_t closest_ms;        // closest two switch-ons
+    uint32_t longest_wait_ms;   // from wanting heat to the relay going on
+};
+
+
+static double now_ns(){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+
+
+static struct result run(int count, int hours, uint32_t stagger, uint64_t seed){
+    struct zone* zones = calloc(count, sizeof(struct zone));
+    struct plant* plants = calloc(count, sizeof(struct plant));
+    int* queue = calloc(count, sizeof(int));
+    uint32_t* wanted_since = calloc(count, sizeof(uint32_t));
+    bool* wanted = calloc(count, sizeof(bool));
+    if(!zones || !plants || !queue || !wanted_since || !wanted){ perror("calloc"); exit(2); }
+
+    // every zone gets its own room and setting
+    for(int i=0; i<count; i++){
+        uint64_t random = seed ^ (uint64_t)i * 0x2545F4914F6CDD1Dull;
+        plant_random_room(&plants[i], &random);
+        plant_thermostat_initialize(&zones[i].thermostat, 650 + (int)plant_random_between(&random, 0, 100));
+    }
+
+    struct zone_scheduler scheduler;
+    zone_scheduler_initialize(&scheduler, zones, queue, count, stagger);
+
+    struct result r = {count, 0, 0, 0, 0, UINT32_MAX, 0};
+    uint32_t last_on = 0;
+    double tick_ns = 0;
+    long ticks = (long)hours * 3600 * 1000 / TICK_MS;
+
+    for(long tick=0; tick<ticks; tick++){
+        uint32_t now = tick * TICK_MS;
+
+        if(tick % SENSE_TICKS == 0){
+            for(int i=0; i<count; i++)
+                plant_sense(&plants[i], &zones[i].thermostat);
+        }
+
+        double start = now_ns();
+        zone_scheduler_tick(&scheduler, now);
+        tick_ns += now_ns() - start;
+
+        int switched_on = 0;
+        int burst = 0;
+        for(int i=0; i<count; i++){
+            struct zone* z = &zones[i];
+            bool wants = z->thermostat.relay_state == ON;
+            if(wants && !wanted[i]){
+                wanted_since[i] = now;
+                burst++;
+            }
+            wanted[i] = wants;
+
+            if(z->output == ON && wanted_since[i] != UINT32_MAX){
+                // just switched on
+                switched_on++;
+                if(now - wanted_since[i] > r.longest_wait_ms) r.longest_wait_ms = now - wanted_since[i];
+                wanted_since[i] = UINT32_MAX;
+            }
+            plant_step(&plants[i], z->output == ON, TICK_MS / 1000.0);
+        }
+
+        if(switched_on){
+            if(r.switch_ons > 0 && now - last_on < r.closest_ms) r.closest_ms = now - last_on;
+            last_on = now;
+            r.switch_ons += switched_on;
+            if(switched_on > 1) r.closest_ms = 0;
+        }
+        if(switched_on > r.most_per_tick) r.most_per_tick = switched_on;
+        if(burst > r.biggest_burst) r.biggest_burst = burst;
+    }
+
+    r.ns_per_zone = tick_ns / ticks / count;
+    free(zones);
+    free(plants);
+    free(queue);
+    free(wanted_since);
+    free(wanted);
+    return r;
+}
+
+
+
+int main(int argc, char** argv){
+
+    int max_zones = DEFAULT_MAX_ZONES;
+    int hours = DEFAULT_HOURS;
+    uint32_t stagger = ZONE_STAGGER_TIME;
+    uint64_t seed = DEFAULT_SEED;
+
+    for(int i=1; i<argc; i++){
+        if(i+1 >= argc){
+            fprintf(stderr, "usage: %s [-z max zones] [-h hours] [-g stagger ms] [-r seed]\n", argv[0]);
+            return 2;
+        }
+        if(strcmp(argv[i], "-z") == 0) max_zones = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-h") == 0) hours = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-g") == 0) stagger = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-r") == 0) seed = strtoull(argv[++i], NULL, 10);
+        else { fprintf(stderr, "unknown option %s\n", argv[i]); return 2; }
+    }
+    if(max_zones < 1 || hours < 1){
+        fprintf(stderr, "need at least one zone and one hour\n");
+        return 2;
+    }
+
+    printf("%d hours, stagger %lu ms\n", hours, (unsigned long)stagger);
+    printf("%6s %12s %10s %9s %9s %11s %12s\n",
+            "zones", "ns/zone/tick", "switch-ons", "most/tick", "burst", "closest ms", "max wait ms");
+
+    int failed = 0;
+    for(int count=1; count<=max_zones; count*=4){
+        struct result r = run(count, hours, stagger, seed);
+        printf("%6d %12.1f %10d %9d %9d %11lu %12lu\n",
+                r.zones, r.ns_per_zone, r.switch_ons, r.most_per_tick, r.biggest_burst,
+                r.switch_ons > 1 ? (unsigned long)r.closest_ms : 0ul,
+                (unsigned long)r.longest_wait_ms);
+        if(r.switch_ons > 1 && r.closest_ms < stagger) failed = 1;
+    }
+
+    if(failed) printf("relays switched on closer together than the stagger time\n");
+    return failed;
+}
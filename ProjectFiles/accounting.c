@@ -0,0 +1,194 @@
+#include "accounting.h"
+#include "aht20.h"
+#include <stdio.h>
+
+
+// ln(humidity / 100) for humidity 1..100, times 2^16
+static const int32_t ln_humidity[100] = {
+    -301804, -256378, -229806, -210952, -196328, -184380, -174277, -165526,
+    -157807, -150902, -144656, -138954, -133708, -128851, -124330, -120100,
+    -116127, -112381, -108838, -105476, -102279, -99230, -96317, -93527,
+    -90852, -88282, -85808, -83425, -81125, -78904, -76755, -74674,
+    -72657, -70701, -68801, -66955, -65159, -63412, -61709, -60050,
+    -58432, -56853, -55310, -53804, -52331, -50891, -49481, -48101,
+    -46750, -45426, -44128, -42856, -41607, -40382, -39180, -37999,
+    -36839, -35699, -34579, -33477, -32394, -31329, -30280, -29248,
+    -28232, -27231, -26246, -25275, -24318, -23375, -22445, -21529,
+    -20625, -19733, -18854, -17985, -17129, -16283, -15448, -14624,
+    -13810, -13006, -12211, -11426, -10651, -9884, -9127, -8378,
+    -7637, -6905, -6181, -5464, -4756, -4055, -3362, -2675,
+    -1996, -1324, -659, 0,
+};
+
+// Magnus formula constants: b times 2^16, and c in 100ths of a degree C
+#define MAGNUS_B 1154744
+#define MAGNUS_C 24312
+
+
+
+static int64_t divide_rounded(int64_t n, int64_t d){
+    return n >= 0 ? (n + d/2) / d : (n - d/2) / d;
+}
+
+static uint32_t isqrt(uint32_t n){
+    uint32_t root = 0;
+    uint32_t bit = 1u << 30;
+    while(bit > n) bit >>= 2;
+    while(bit){
+        if(n >= root + bit){
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+
+// Magnus formula, on 100ths of a degree C
+int accounting_dew_point(int temperature, int humidity){
+    if(humidity < 1) humidity = 1;
+    if(humidity > 100) humidity = 100;
+
+    int64_t celsius = divide_rounded((int64_t)(temperature - 320) * 50, 9);
+    int64_t gamma = ln_humidity[humidity - 1] + MAGNUS_B * celsius / (MAGNUS_C + celsius);
+    int64_t dew = divide_rounded(MAGNUS_C * gamma, MAGNUS_B - gamma);
+    return divide_rounded(dew * 9, 50) + 320;
+}
+
+
+// The US National Weather Service's: a simple formula, or the Rothfusz
+// regression with its adjustments when that comes out at 80F or more.
+// Coefficients are times 10^8, on 10ths of a degree
+int accounting_heat_index(int temperature, int humidity){
+    int64_t t = temperature;
+    int64_t r = humidity;
+
+    // times 200, so deciding which formula to use isn't thrown by rounding
+    int64_t simple = 100*t + 61000 + 120*(t - 680) + 94*r;
+    if(simple + 200*t < 320000) return divide_rounded(simple, 200);
+
+    int64_t sum = -42379000000
+                + 204901523 * t
+                + 10143331270 * r
+                - 22475541 * t * r
+                - divide_rounded(683783 * t * t, 10)
+                - 54817170 * r * r
+                + divide_rounded(122874 * t * t * r, 10)
+                + 85282 * t * r * r
+                - divide_rounded(199 * t * t * r * r, 10);
+    int64_t index = divide_rounded(sum, 100000000);
+
+    if(r < 13 && t >= 800 && t <= 1120){
+        int64_t from_95 = t > 950 ? t - 950 : 950 - t;
+        uint32_t root = isqrt((uint32_t)((170 - from_95) * 65536 / 170));   // times 2^8
+        index -= divide_rounded((13 - r) * 10 * root, 4 * 256);
+    }
+    else if(r > 85 && t >= 800 && t <= 870){
+        index += divide_rounded((r - 85) * (870 - t), 50);
+    }
+    return index;
+}
+
+
+
+void accounting_initialize(struct accounting* a){
+    *a = (struct accounting){0};
+}
+
+
+static int outside_band(const struct accounting* a){
+    int low = a->setting - ACCOUNTING_COMFORT_BAND;
+    int high = a->setting + a->threshold + ACCOUNTING_COMFORT_BAND;
+    if(a->temperature < low) return low - a->temperature;
+    if(a->temperature > high) return a->temperature - high;
+    return 0;
+}
+
+
+static void finish_hour(struct accounting* a){
+    // the slot being replaced is from 24 hours ago, or still 0
+    a->day_on -= a->hour_on[a->hour_index];
+    a->hour_on[a->hour_index] = a->current_hour_on;
+    a->day_on += a->current_hour_on;
+
+    a->hour_index = (a->hour_index + 1) % ACCOUNTING_HOURS;
+    if(a->hours_done < ACCOUNTING_HOURS) a->hours_done++;
+    a->current_hour_on = 0;
+    a->current_hour_elapsed = 0;
+}
+
+
+void accounting_sample(struct accounting* a, uint32_t now, int temperature, int humidity,
+                       int setting, int threshold, bool relay_on){
+    if(a->started){
+        // everything since the last sample is counted as the state it left
+        uint32_t elapsed = now - a->last_time;
+        a->elapsed += elapsed;
+        if(a->relay_on) a->runtime += elapsed;
+        if(a->valid) a->outside += (uint64_t)outside_band(a) * elapsed;
+
+        // splitting at hour boundaries only loops more than once if a
+        // sample was missed for a whole hour
+        while(elapsed > 0){
+            uint32_t room = ACCOUNTING_MS_PER_HOUR - a->current_hour_elapsed;
+            uint32_t part = elapsed < room ? elapsed : room;
+            if(a->relay_on) a->current_hour_on += part;
+            a->current_hour_elapsed += part;
+            elapsed -= part;
+            if(a->current_hour_elapsed == ACCOUNTING_MS_PER_HOUR) finish_hour(a);
+        }
+
+        if(relay_on && !a->relay_on) a->cycles++;
+    }
+
+    // the relay is real either way, but a bad reading only counts for time
+    bool valid = AHT20_VALID_TEMPERATURE(temperature);
+    if(valid && (!a->valid || temperature != a->temperature || humidity != a->humidity)){
+        a->dew_point = accounting_dew_point(temperature, humidity);
+        a->heat_index = accounting_heat_index(temperature, humidity);
+    }
+
+    a->started = true;
+    a->valid = valid;
+    a->last_time = now;
+    a->temperature = temperature;
+    a->humidity = humidity;
+    a->setting = setting;
+    a->threshold = threshold;
+    a->relay_on = relay_on;
+}
+
+
+
+int accounting_hour_duty(const struct accounting* a){
+    if(a->hours_done == 0) return 0;
+    int last = (a->hour_index + ACCOUNTING_HOURS - 1) % ACCOUNTING_HOURS;
+    return (uint64_t)a->hour_on[last] * 1000 / ACCOUNTING_MS_PER_HOUR;
+}
+
+int accounting_day_duty(const struct accounting* a){
+    if(a->hours_done == 0) return 0;
+    return (uint64_t)a->day_on * 1000 / ((uint64_t)a->hours_done * ACCOUNTING_MS_PER_HOUR);
+}
+
+uint32_t accounting_degree_minutes(const struct accounting* a){
+    return a->outside / 60000;
+}
+
+
+
+void accounting_print(const struct accounting* a){
+    printf("relay on %0.2fh of %0.2fh, %lu cycles\n",
+        a->runtime / 3.6e6, a->elapsed / 3.6e6, (unsigned long)a->cycles);
+    printf("duty last hour %0.1f%%, last %d hours %0.1f%%\n",
+        accounting_hour_duty(a) / 10.0, a->hours_done, accounting_day_duty(a) / 10.0);
+    printf("%0.1f degree-minutes outside the comfort band\n", accounting_degree_minutes(a) / 10.0);
+    if(a->valid)
+        printf("dew point %0.1fF, heat index %0.1fF\n", a->dew_point / 10.0, a->heat_index / 10.0);
+    else
+        printf("no reading\n");
+}
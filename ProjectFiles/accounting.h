@@ -0,0 +1,74 @@
+#ifndef ACCOUNTING_H
+#define ACCOUNTING_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+
+// Keeps running totals of how much the relay has been on and how
+// comfortable the room has been, plus dew point and heat index from the
+// latest reading. Each sample is constant work and memory is fixed: the
+// only history is the relay on time for each of the last 24 hours.
+//
+// Temperatures are in 10ths of a degree F and duty cycles in 10ths of a
+// percent, so all the maths is integer.
+
+#define ACCOUNTING_HOURS 24
+#define ACCOUNTING_COMFORT_BAND 10      // how far outside setting..setting+threshold is still comfortable
+#define ACCOUNTING_MS_PER_HOUR 3600000
+
+struct accounting {
+    bool started;
+    uint32_t last_time;     // ms
+
+    // what's held since last_time
+    bool valid;             // temperature is a real reading
+    int temperature;
+    int humidity;
+    int setting;
+    int threshold;
+    bool relay_on;
+
+    uint64_t elapsed;       // ms
+    uint64_t runtime;       // ms with the relay on
+    uint32_t cycles;        // times the relay came on
+    uint64_t outside;       // 10ths of a degree outside the band, times ms
+
+    // on time in the last 24 whole hours, counted from the first sample
+    uint32_t hour_on[ACCOUNTING_HOURS];
+    int hour_index;         // where the current hour goes when it's done
+    int hours_done;         // up to ACCOUNTING_HOURS
+    uint32_t current_hour_on;
+    uint32_t current_hour_elapsed;
+    uint32_t day_on;        // sum of hour_on
+
+    int dew_point;
+    int heat_index;
+};
+
+
+void accounting_initialize(struct accounting* a);
+
+// now is in ms. The readings and relay are what holds from now until the
+// next sample. Call as often as the relay can change. Until there's a
+// reading in 30..110F only the relay is counted
+void accounting_sample(struct accounting* a, uint32_t now, int temperature, int humidity,
+                       int setting, int threshold, bool relay_on);
+
+// on time over the last whole hour, and over the last 24 (or as many as
+// there have been). 10ths of a percent
+int accounting_hour_duty(const struct accounting* a);
+int accounting_day_duty(const struct accounting* a);
+
+// 10ths of a degree-minute outside the comfort band
+uint32_t accounting_degree_minutes(const struct accounting* a);
+
+// from a temperature and relative humidity in percent
+int accounting_dew_point(int temperature, int humidity);
+int accounting_heat_index(int temperature, int humidity);
+
+// console command
+void accounting_print(const struct accounting* a);
+
+
+#endif
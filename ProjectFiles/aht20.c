@@ -8,38 +8,57 @@
 
 #define TEMP_HUM_DEFAULT_VALUE 0
 
-static bool initialized = false;
-static int temperature = TEMP_HUM_DEFAULT_VALUE;
-static int humidity = TEMP_HUM_DEFAULT_VALUE;
 
-void aht20_initialize(){
+// point the mux at this sensor. One straight on the bus still has to
+// close every mux channel if there's a mux, or the aht20 that was
+// selected last answers at the same address too
+static bool select_sensor(struct aht20* sensor){
+    uint8_t channels;
+    if (sensor->mux_channel != AHT20_NO_MUX) channels = 1 << sensor->mux_channel;
+    else if (sensor->mux_present) channels = 0;
+    else return true;
+    return i2c_module_send(AHT20_MUX_ADDRESS, &channels, 1) == 1;
+}
+
+
+void aht20_initialize(struct aht20* sensor){
     // Note: make sure device has been powered on for 20 milliseconds 
     // before communicating
 
     uint8_t txdata[3] = {AHT20_INITIALIZE_BYTE, 0x08, 0x00};
+    select_sensor(sensor);
     i2c_module_send(AHT20_ADDRESS, txdata, 3);
-    initialized = true;
+    sensor->temperature = TEMP_HUM_DEFAULT_VALUE;
+    sensor->humidity = TEMP_HUM_DEFAULT_VALUE;
+    sensor->initialized = true;
 }
 
 
-void aht20_start_measurement(){
+bool aht20_start_measurement(struct aht20* sensor){
     // don't send data until the device has been initialized
-    if (!initialized) return;
+    if (!sensor->initialized) return false;
 
     // trigger measurement
     uint8_t txdata[3] = {AHT20_MEASURE_BYTE, 0x33, 0x00};
-    i2c_module_send(AHT20_ADDRESS, txdata, 3);
+    if (!select_sensor(sensor)) return false;
+    return i2c_module_send(AHT20_ADDRESS, txdata, 3) == 3;
 
     //takes at least 80ms before measurement is ready to read
 }
 
-void aht20_read_measurement(){
+bool aht20_read_measurement(struct aht20* sensor){
     // don't send data until the device has been initialized
-    if (!initialized) return;
+    if (!sensor->initialized) return false;
 
     //get recent temperature measurement
-    uint8_t rxdata[6];
-    i2c_module_read(AHT20_ADDRESS, rxdata, 6);
+    uint8_t rxdata[AHT20_FRAME_LENGTH];
+    if (!select_sensor(sensor)) return false;
+    // if the read failed rxdata is garbage, so keep the last values
+    if (i2c_module_read(AHT20_ADDRESS, rxdata, AHT20_FRAME_LENGTH) != AHT20_FRAME_LENGTH)
+        return false;
+    for (int i=0; i<AHT20_FRAME_LENGTH; i++){
+        sensor->raw_frame[i] = rxdata[i];
+    }
 
     //calculate it from raw values
     unsigned long __humi = 0;
@@ -54,7 +73,7 @@ void aht20_read_measurement(){
     // multiply by magic constant, as per the datasheet
     float h = (float)__humi/1048576.0;
     int h_int = (int)(h*100);
-    humidity = h_int;
+    sensor->humidity = h_int;
 
     __temp = rxdata[3]&0x0f;
     __temp <<=8;
@@ -69,20 +88,26 @@ void aht20_read_measurement(){
     int temp_int = (int) (t_f * 10);
 
     //make sure it's a valid number
-    //(arbitrary limits, since I'm measuring room temp, 
-    //between 30 and 110 degrees would be expected)
-    if (temp_int > 300 && temp_int < 1100)
-        temperature = temp_int;        
+    if (AHT20_VALID_TEMPERATURE(temp_int))
+        sensor->temperature = temp_int;        
 
     // print them
     // printf("temp: \t\t%0.2fF\n", t_f);
     // printf("humidity: \t%d%%\n\n", h_int);
+    return true;
+}
+
+int aht20_get_temp(struct aht20* sensor){
+    return sensor->temperature;
 }
 
-int aht20_get_temp(){
-    return temperature;
+int aht20_get_humidity(struct aht20* sensor){
+    return sensor->humidity;
 }
 
-int aht20_get_humidity(){
-    return humidity;
+// copies out the 6 bytes from the last read, for recording
+void aht20_get_raw_frame(struct aht20* sensor, uint8_t* frame){
+    for (int i=0; i<AHT20_FRAME_LENGTH; i++){
+        frame[i] = sensor->raw_frame[i];
+    }
 }
\ No newline at end of file
@@ -1,15 +1,46 @@
 #ifndef AHT20_H
 #define AHT20_H
 
-void aht20_initialize();
+#include "stdint.h"
+#include "stdbool.h"
 
-void aht20_start_measurement();
+#define AHT20_FRAME_LENGTH 6
 
-void aht20_read_measurement();
+// every aht20 is at the same address, so more than one needs an i2c mux
+// (TCA9548A). Its address pins are set for 0x71 so it doesn't clash with
+// the display at 0x70
+#define AHT20_MUX_ADDRESS 0x71
+#define AHT20_NO_MUX -1
 
-int aht20_get_temp();
+// readings outside this (10ths of a degree F) are thrown away. Arbitrary,
+// it's measuring room temperature. Anything else that gets a temperature
+// from the sensor can use it to spot a placeholder like
+// THERMOSTAT_NO_READING
+#define AHT20_VALID_TEMPERATURE(t) ((t) > 300 && (t) < 1100)
 
-int aht20_get_humidity();
+// one per sensor. zero it and set mux_channel (and mux_present) before
+// calling aht20_initialize
+struct aht20 {
+    bool initialized;
+    int mux_channel;        // 0-7, or AHT20_NO_MUX if it's straight on the bus
+    bool mux_present;       // straight on the bus, but other sensors are behind a mux
+    int temperature;
+    int humidity;
+    uint8_t raw_frame[AHT20_FRAME_LENGTH];
+};
+
+void aht20_initialize(struct aht20* sensor);
+
+// these return false if the sensor didn't answer
+bool aht20_start_measurement(struct aht20* sensor);
+
+bool aht20_read_measurement(struct aht20* sensor);
+
+int aht20_get_temp(struct aht20* sensor);
+
+int aht20_get_humidity(struct aht20* sensor);
+
+void aht20_get_raw_frame(struct aht20* sensor, uint8_t* frame);
 
 
 #endif
\ No newline at end of file
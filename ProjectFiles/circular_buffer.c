@@ -2,33 +2,28 @@
 
 
 
-#define BUF_SIZE 4
-static int buffer[BUF_SIZE];
-static int current_position = 0;
-
-
-
-void buffer_initialize(int init_avg){
+void buffer_initialize(struct circular_buffer* b, int init_avg){
     for (int i=0; i<BUF_SIZE; i++){
-        buffer[i] = init_avg;
+        b->buffer[i] = init_avg;
     }
+    b->current_position = 0;
 }
 
-void buffer_append(int new_num){
-    buffer[current_position] = new_num;
-    current_position++;
-    if(current_position >= BUF_SIZE){
-        current_position = 0;
+void buffer_append(struct circular_buffer* b, int new_num){
+    b->buffer[b->current_position] = new_num;
+    b->current_position++;
+    if(b->current_position >= BUF_SIZE){
+        b->current_position = 0;
     }
 }
 
 
 
-int buffer_get_avg(){
+int buffer_get_avg(struct circular_buffer* b){
     int total = 0;
     for(int i=0; i<BUF_SIZE; i++){
         // * 10 so we don't lose granularity in integer divide
-        total += buffer[i] * 10;
+        total += b->buffer[i] * 10;
     }
     return (total / BUF_SIZE) / 10;
 }
@@ -2,12 +2,19 @@
 #define CIRCULAR_BUFFER_H
 
 
+#define BUF_SIZE 4
 
-void buffer_initialize(int init_avg);
+struct circular_buffer {
+    int buffer[BUF_SIZE];
+    int current_position;
+};
 
-void buffer_append(int new_num);
 
-int buffer_get_avg();
+void buffer_initialize(struct circular_buffer* b, int init_avg);
+
+void buffer_append(struct circular_buffer* b, int new_num);
+
+int buffer_get_avg(struct circular_buffer* b);
 
 
 
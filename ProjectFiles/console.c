@@ -0,0 +1,129 @@
+#include "console.h"
+#include <FreeRTOS.h>
+#include <task.h>
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "trace.h"
+
+
+
+struct command {
+    const char* name;
+    const char* description;
+    void (*run)();
+    void (*run_with_args)(const char* args);
+};
+
+#define MAX_TASKS 16
+
+static void print_help();
+static void print_stack();
+
+static const struct command commands[] = {
+    {"help",    "list commands",                    print_help},
+    {"trace",   "dump the task and i2c trace",      trace_dump},
+    {"stack",   "least free stack each task has had", print_stack},
+};
+#define COMMAND_COUNT (sizeof(commands) / sizeof(commands[0]))
+
+// from console_add_command
+static struct command added_commands[CONSOLE_MAX_ADDED_COMMANDS];
+static int added_count = 0;
+
+
+
+void console_add_command(const char* name, const char* description, void (*run)()){
+    if(added_count >= CONSOLE_MAX_ADDED_COMMANDS) return;
+    added_commands[added_count].name = name;
+    added_commands[added_count].description = description;
+    added_commands[added_count].run = run;
+    added_commands[added_count].run_with_args = NULL;
+    added_count++;
+}
+
+void console_add_command_with_args(const char* name, const char* description,
+                                   void (*run)(const char* args)){
+    if(added_count >= CONSOLE_MAX_ADDED_COMMANDS) return;
+    added_commands[added_count].name = name;
+    added_commands[added_count].description = description;
+    added_commands[added_count].run = NULL;
+    added_commands[added_count].run_with_args = run;
+    added_count++;
+}
+
+
+
+static void print_help(){
+    for(int i=0; i<COMMAND_COUNT; i++){
+        printf("%-10s %s\n", commands[i].name, commands[i].description);
+    }
+    for(int i=0; i<added_count; i++){
+        printf("%-10s %s\n", added_commands[i].name, added_commands[i].description);
+    }
+}
+
+
+// the same as uxTaskGetStackHighWaterMark() for every task. Static so it
+// doesn't come out of the console's own stack
+static void print_stack(){
+    static TaskStatus_t tasks[MAX_TASKS];
+    int count = uxTaskGetSystemState(tasks, MAX_TASKS, NULL);
+    for(int i=0; i<count; i++){
+        printf("%-18s %u words free\n", tasks[i].pcTaskName, (unsigned)tasks[i].usStackHighWaterMark);
+    }
+}
+
+
+static void run_command(char* line){
+    if(line[0] == 0) return;
+
+    // split the name from any arguments
+    char* args = strchr(line, ' ');
+    if(args){
+        *args++ = 0;
+        while(*args == ' ') args++;
+    }
+    else {
+        args = "";
+    }
+
+    for(int i=0; i<COMMAND_COUNT; i++){
+        if(strcmp(line, commands[i].name) == 0){
+            commands[i].run();
+            return;
+        }
+    }
+    for(int i=0; i<added_count; i++){
+        if(strcmp(line, added_commands[i].name) == 0){
+            if(added_commands[i].run_with_args)
+                added_commands[i].run_with_args(args);
+            else
+                added_commands[i].run();
+            return;
+        }
+    }
+    printf("unknown command \"%s\", try help\n", line);
+}
+
+
+void console_task(){
+    char line[CONSOLE_LINE_LENGTH];
+    int length = 0;
+
+    while(true){
+        // read whatever has come in, without waiting
+        int c;
+        while((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT){
+            if(c == '\r' || c == '\n'){
+                line[length] = 0;
+                run_command(line);
+                length = 0;
+            }
+            else if(length < CONSOLE_LINE_LENGTH - 1){
+                line[length++] = c;
+            }
+        }
+        vTaskDelay(CONSOLE_POLL_TIME);
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+
+// Reads commands typed over usb serial, one per line, and runs them.
+// Type "help" for the list.
+
+#define CONSOLE_LINE_LENGTH 32
+#define CONSOLE_POLL_TIME 20
+#define CONSOLE_MAX_ADDED_COMMANDS 8
+
+
+// add a command that isn't built in. Call before the scheduler starts
+void console_add_command(const char* name, const char* description, void (*run)());
+
+// same, for a command that takes arguments. run gets the rest of the line
+// after the name, which is "" if there wasn't anything
+void console_add_command_with_args(const char* name, const char* description,
+                                   void (*run)(const char* args));
+
+// FreeRTOS task
+void console_task();
+
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef I2C_HW_H
+#define I2C_HW_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+
+// The parts of the i2c module that touch the hardware. i2c_hw_pico.c is
+// the real one; the PC build has a fake one so i2c_module.c can be tested
+// with faults injected.
+
+// clocking 9 pulses out and a stop at 100kHz, then setting the
+// peripheral back up
+#define I2C_RECOVERY_MAX_US 300
+
+
+void i2c_hw_initialize();
+
+// these return bytes transferred or an I2C_MODULE_ error
+int i2c_hw_write(int addr, const uint8_t* data, int length, uint32_t timeout_us);
+
+int i2c_hw_read(int addr, uint8_t* data, int length, uint32_t timeout_us);
+
+// frees a device holding SDA low and resets the peripheral
+void i2c_hw_recover();
+
+uint32_t i2c_hw_time_us();
+
+// so tasks don't interleave transactions. false if it wasn't free in time
+bool i2c_hw_lock(uint32_t timeout_ms);
+
+void i2c_hw_unlock();
+
+
+#endif
@@ -0,0 +1,116 @@
+#include "i2c_hw.h"
+#include "i2c_module.h"
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+#include "hardware/i2c.h"
+#include "pico/stdlib.h"
+#include "pico/binary_info.h"
+#include "trace.h"
+
+
+#define I2C_BAUDRATE (100 * 1000)
+#define HALF_CLOCK_US 5
+#define CLEAR_CLOCKS 9
+
+
+static SemaphoreHandle_t bus_mutex = NULL;
+
+
+
+static void setup_peripheral(){
+    i2c_init(i2c_default, I2C_BAUDRATE);
+    gpio_set_function(PICO_DEFAULT_I2C_SDA_PIN, GPIO_FUNC_I2C);
+    gpio_set_function(PICO_DEFAULT_I2C_SCL_PIN, GPIO_FUNC_I2C);
+    gpio_pull_up(PICO_DEFAULT_I2C_SDA_PIN);
+    gpio_pull_up(PICO_DEFAULT_I2C_SCL_PIN);
+}
+
+static int from_sdk_result(int result){
+    if(result >= 0) return result;
+    if(result == PICO_ERROR_TIMEOUT) return I2C_MODULE_TIMEOUT;
+    return I2C_MODULE_ERROR;
+}
+
+
+
+void i2c_hw_initialize(){
+    setup_peripheral();
+    // Make the I2C pins available to picotool
+    bi_decl(bi_2pins_with_func(PICO_DEFAULT_I2C_SDA_PIN, PICO_DEFAULT_I2C_SCL_PIN, GPIO_FUNC_I2C));
+
+    if(!bus_mutex)
+        bus_mutex = xSemaphoreCreateMutex();
+}
+
+
+int i2c_hw_write(int addr, const uint8_t* data, int length, uint32_t timeout_us){
+    trace_i2c_start(addr, length, false);
+    int result = i2c_write_timeout_us(i2c_default, addr, data, length, false, timeout_us);
+    trace_i2c_end(addr, result);
+    return from_sdk_result(result);
+}
+
+
+int i2c_hw_read(int addr, uint8_t* data, int length, uint32_t timeout_us){
+    trace_i2c_start(addr, length, true);
+    int result = i2c_read_timeout_us(i2c_default, addr, data, length, false, timeout_us);
+    trace_i2c_end(addr, result);
+    return from_sdk_result(result);
+}
+
+
+// A device that was in the middle of sending when things went wrong can
+// hold SDA low forever. Clock SCL by hand until it lets go, then send a
+// stop so everyone is back to idle.
+void i2c_hw_recover(){
+    const uint sda = PICO_DEFAULT_I2C_SDA_PIN;
+    const uint scl = PICO_DEFAULT_I2C_SCL_PIN;
+
+    i2c_deinit(i2c_default);
+
+    // open drain by hand: output low to pull down, input to let the
+    // pullup take it high
+    gpio_set_function(sda, GPIO_FUNC_SIO);
+    gpio_set_function(scl, GPIO_FUNC_SIO);
+    gpio_put(sda, 0);
+    gpio_put(scl, 0);
+    gpio_set_dir(sda, GPIO_IN);
+    gpio_set_dir(scl, GPIO_IN);
+    busy_wait_us(HALF_CLOCK_US);
+
+    for(int i=0; i<CLEAR_CLOCKS && !gpio_get(sda); i++){
+        gpio_set_dir(scl, GPIO_OUT);
+        busy_wait_us(HALF_CLOCK_US);
+        gpio_set_dir(scl, GPIO_IN);
+        busy_wait_us(HALF_CLOCK_US);
+    }
+
+    // stop: SDA goes high while SCL is high
+    gpio_set_dir(scl, GPIO_OUT);
+    gpio_set_dir(sda, GPIO_OUT);
+    busy_wait_us(HALF_CLOCK_US);
+    gpio_set_dir(scl, GPIO_IN);
+    busy_wait_us(HALF_CLOCK_US);
+    gpio_set_dir(sda, GPIO_IN);
+    busy_wait_us(HALF_CLOCK_US);
+
+    setup_peripheral();
+}
+
+
+uint32_t i2c_hw_time_us(){
+    return time_us_32();
+}
+
+
+bool i2c_hw_lock(uint32_t timeout_ms){
+    // nothing else can be running before the scheduler starts
+    if(xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED) return true;
+    return xSemaphoreTake(bus_mutex, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+}
+
+void i2c_hw_unlock(){
+    if(xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED) return;
+    xSemaphoreGive(bus_mutex);
+}
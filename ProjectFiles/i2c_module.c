@@ -1,41 +1,137 @@
 #include "i2c_module.h"
+#include "i2c_hw.h"
+#include <stdio.h>
 
-#include "hardware/i2c.h"
-#include "pico/stdlib.h"
-#include "pico/binary_info.h"
 
 
+// the PC build gives each thread its own bus, so it makes these thread local
+#ifndef I2C_MODULE_LOCAL
+#define I2C_MODULE_LOCAL
+#endif
 
-struct message {
-    int addr;
-    uint8_t* txbuffer;
-    int length;
-};
+static I2C_MODULE_LOCAL struct i2c_device_stats devices[I2C_MAX_DEVICES];
+static I2C_MODULE_LOCAL int device_count = 0;
+static I2C_MODULE_LOCAL struct i2c_bus_stats bus_stats;
+
+
+
+static struct i2c_device_stats* stats_for(int addr){
+    for(int i=0; i<device_count; i++){
+        if(devices[i].addr == addr) return &devices[i];
+    }
+    if(device_count >= I2C_MAX_DEVICES) return NULL;
+
+    struct i2c_device_stats* d = &devices[device_count++];
+    *d = (struct i2c_device_stats){0};
+    d->addr = addr;
+    return d;
+}
+
+
+static uint32_t timeout_for(int length){
+    return I2C_TIMEOUT_BASE_US + length * I2C_TIMEOUT_PER_BYTE_US;
+}
+
+
+// counts the result, and clears the bus if the device looks stuck. There's
+// no retry here - the callers all try again next time round anyway, and it
+// keeps the worst case to one timeout
+static int finish(int addr, int result, uint32_t start){
+    struct i2c_device_stats* d = stats_for(addr);
+    bool recover = false;
+
+    if(result == I2C_MODULE_TIMEOUT){
+        recover = true;
+    }
+    else if(result < 0 && d && d->consecutive_errors + 1 >= I2C_ERRORS_BEFORE_RECOVERY){
+        recover = true;
+    }
+    if(recover){
+        i2c_hw_recover();
+        bus_stats.recoveries++;
+    }
+
+    if(d){
+        uint32_t elapsed = i2c_hw_time_us() - start;
+        d->transactions++;
+        d->total_us += elapsed;
+        if(elapsed > d->max_us) d->max_us = elapsed;
+        if(result < 0){
+            d->errors++;
+            if(result == I2C_MODULE_TIMEOUT) d->timeouts++;
+            d->consecutive_errors = recover ? 0 : d->consecutive_errors + 1;
+        }
+        else {
+            d->consecutive_errors = 0;
+        }
+    }
+    return result;
+}
 
-//todo: make a message queue, have this module handle
-// all timing, to avoid hardware conflicts
 
 
 void i2c_module_initialize(){
-    i2c_init(i2c_default, 100 * 1000);
-    gpio_set_function(PICO_DEFAULT_I2C_SDA_PIN, GPIO_FUNC_I2C);
-    gpio_set_function(PICO_DEFAULT_I2C_SCL_PIN, GPIO_FUNC_I2C);
-    gpio_pull_up(PICO_DEFAULT_I2C_SDA_PIN);
-    gpio_pull_up(PICO_DEFAULT_I2C_SCL_PIN);
-    // Make the I2C pins available to picotool
-    bi_decl(bi_2pins_with_func(PICO_DEFAULT_I2C_SDA_PIN, PICO_DEFAULT_I2C_SCL_PIN, GPIO_FUNC_I2C));
+    device_count = 0;
+    bus_stats = (struct i2c_bus_stats){0};
+    i2c_hw_initialize();
+}
+
+
+
+int i2c_module_send(int addr, uint8_t* txdata, int length){
+
+    if(!i2c_hw_lock(I2C_LOCK_TIMEOUT_MS)){
+        bus_stats.lock_timeouts++;
+        return I2C_MODULE_BUSY;
+    }
+    uint32_t start = i2c_hw_time_us();
+    int result = i2c_hw_write(addr, txdata, length, timeout_for(length));
+    result = finish(addr, result, start);
+    i2c_hw_unlock();
+    return result;
 }
 
 
+int i2c_module_read(int addr, uint8_t* rxdata, int length){
 
-void i2c_module_send(int addr, uint8_t* txdata, int length){
-        
-    i2c_write_blocking(i2c_default, addr, txdata, length, false);
+    if(!i2c_hw_lock(I2C_LOCK_TIMEOUT_MS)){
+        bus_stats.lock_timeouts++;
+        return I2C_MODULE_BUSY;
+    }
+    uint32_t start = i2c_hw_time_us();
+    int result = i2c_hw_read(addr, rxdata, length, timeout_for(length));
+    result = finish(addr, result, start);
+    i2c_hw_unlock();
+    return result;
 }
 
 
-void i2c_module_read(int addr, uint8_t* rxdata, int length){
 
-    i2c_read_blocking(i2c_default, addr, rxdata, 6, false);
+uint32_t i2c_module_worst_case_us(int length){
+    return timeout_for(length) + I2C_RECOVERY_MAX_US;
+}
+
+const struct i2c_device_stats* i2c_module_get_stats(int addr){
+    for(int i=0; i<device_count; i++){
+        if(devices[i].addr == addr) return &devices[i];
+    }
+    return NULL;
+}
+
+const struct i2c_bus_stats* i2c_module_get_bus_stats(){
+    return &bus_stats;
+}
+
 
+void i2c_module_print_stats(){
+    for(int i=0; i<device_count; i++){
+        const struct i2c_device_stats* d = &devices[i];
+        printf("0x%02x: %lu transactions, %lu errors, %lu timeouts, mean %luus, max %luus\n",
+            d->addr, (unsigned long)d->transactions, (unsigned long)d->errors,
+            (unsigned long)d->timeouts,
+            (unsigned long)(d->transactions ? d->total_us / d->transactions : 0),
+            (unsigned long)d->max_us);
+    }
+    printf("bus: %lu recoveries, %lu lock timeouts\n",
+        (unsigned long)bus_stats.recoveries, (unsigned long)bus_stats.lock_timeouts);
 }
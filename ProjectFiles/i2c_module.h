@@ -2,13 +2,63 @@
 #define I2C_MODULE_H
 
 #include "stdint.h"
+#include "stdbool.h"
+
+
+// Every transaction has a timeout based on its length, so a stuck device
+// can't hang the task that's talking to it. After a timeout (or a few
+// errors in a row from one device) the bus is cleared and the i2c
+// peripheral set up again. Tasks take turns on the bus.
+//
+// send and read return the number of bytes transferred, or one of the
+// negative errors below.
+
+#define I2C_MODULE_TIMEOUT  -1
+#define I2C_MODULE_ERROR    -2      // nack, or anything else the hardware didn't like
+#define I2C_MODULE_BUSY     -3      // another task had the bus for too long
+
+#define I2C_TIMEOUT_BASE_US 500
+#define I2C_TIMEOUT_PER_BYTE_US 200     // 90us per byte at 100kHz, plus slack
+#define I2C_ERRORS_BEFORE_RECOVERY 3
+#define I2C_LOCK_TIMEOUT_MS 50
+#define I2C_MAX_DEVICES 4
+
+
+struct i2c_device_stats {
+    int addr;
+    uint32_t transactions;
+    uint32_t errors;
+    uint32_t timeouts;
+    uint32_t total_us;
+    uint32_t max_us;
+    int consecutive_errors;
+};
+
+struct i2c_bus_stats {
+    uint32_t recoveries;
+    uint32_t lock_timeouts;
+};
 
 
 void i2c_module_initialize();
 
-void i2c_module_send(int addr, uint8_t* txdata, int length);
+int i2c_module_send(int addr, uint8_t* txdata, int length);
+
+int i2c_module_read(int addr, uint8_t* rxdata, int length);
+
+// the longest one transaction of this length can hold the bus, including
+// clearing it afterwards. A caller can also wait for another task to let
+// go of the bus first, which is up to the worst case of the longest
+// transaction that task makes
+uint32_t i2c_module_worst_case_us(int length);
+
+// NULL if addr has never been used
+const struct i2c_device_stats* i2c_module_get_stats(int addr);
+
+const struct i2c_bus_stats* i2c_module_get_bus_stats();
 
-void i2c_module_read(int addr, uint8_t* rxdata, int length);
+// console command
+void i2c_module_print_stats();
 
 
 #endif
@@ -0,0 +1,60 @@
+#include "latency.h"
+
+
+
+// values below 4 get a bucket each. Above that, the top bit picks the power
+// of 2 and the next two bits pick one of 4 buckets inside it
+static int bucket_of(uint32_t us){
+    if(us < LATENCY_SUB_BUCKETS) return us;
+
+    int top_bit = 31 - __builtin_clz(us);
+    int sub = (us >> (top_bit - 2)) & (LATENCY_SUB_BUCKETS - 1);
+    return (top_bit - 1) * LATENCY_SUB_BUCKETS + sub;
+}
+
+// the largest value that goes in a bucket
+static uint32_t bucket_top(int bucket){
+    if(bucket < LATENCY_SUB_BUCKETS) return bucket;
+
+    int top_bit = bucket / LATENCY_SUB_BUCKETS + 1;
+    int sub = bucket % LATENCY_SUB_BUCKETS;
+    uint64_t bottom = ((uint64_t)(LATENCY_SUB_BUCKETS + sub)) << (top_bit - 2);
+    uint64_t top = bottom + (1ull << (top_bit - 2)) - 1;
+    return top > UINT32_MAX ? UINT32_MAX : top;
+}
+
+
+
+void latency_reset(struct latency_histogram* h){
+    for(int i=0; i<LATENCY_BUCKETS; i++){
+        h->counts[i] = 0;
+    }
+    h->total = 0;
+    h->max = 0;
+}
+
+
+void latency_record(struct latency_histogram* h, uint32_t us){
+    h->counts[bucket_of(us)]++;
+    h->total++;
+    if(us > h->max) h->max = us;
+}
+
+
+uint32_t latency_percentile(const struct latency_histogram* h, int percent){
+    if(h->total == 0) return 0;
+
+    // the sample we want, counting from 1
+    uint32_t wanted = ((uint64_t)h->total * percent + 99) / 100;
+    if(wanted == 0) wanted = 1;
+
+    uint32_t seen = 0;
+    for(int i=0; i<LATENCY_BUCKETS; i++){
+        seen += h->counts[i];
+        if(seen >= wanted){
+            uint32_t top = bucket_top(i);
+            return top < h->max ? top : h->max;
+        }
+    }
+    return h->max;
+}
@@ -0,0 +1,29 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+
+// Histogram of latencies in microseconds, for percentiles without keeping
+// every sample. Each power of 2 is split into 4 buckets, so a percentile
+// is accurate to within 25%.
+
+#define LATENCY_SUB_BUCKETS 4
+#define LATENCY_BUCKETS (32 * LATENCY_SUB_BUCKETS)
+
+struct latency_histogram {
+    uint32_t counts[LATENCY_BUCKETS];
+    uint32_t total;
+    uint32_t max;
+};
+
+
+void latency_reset(struct latency_histogram* h);
+
+void latency_record(struct latency_histogram* h, uint32_t us);
+
+// upper edge of the bucket the percentile falls in. percent is 0 to 100
+uint32_t latency_percentile(const struct latency_histogram* h, int percent);
+
+
+#endif
@@ -1,5 +1,6 @@
 #include <FreeRTOS.h>
 #include <task.h>
+#include <queue.h>
 #include <stdio.h>
 #include "pico/stdlib.h"
 #include "hardware/i2c.h"
@@ -8,39 +9,82 @@
 #include "aht20.h"
 #include "i2c_module.h"
 #include "timers.h"
-#include "circular_buffer.h"
+#include "thermostat.h"
+#include "recorder.h"
+#include "console.h"
+#include "ui.h"
+#include "latency.h"
+#include "zone_scheduler.h"
+#include "optimal_start.h"
+#include "accounting.h"
+#if THERMOSTAT_WIFI
+#include "net.h"
+#include "telemetry.h"
+#endif
 
 #define BTN_PRESSED 0
 #define BTN_RELEASED 1
-#define ON 1
-#define OFF 0
 #define TEMP_UP 1
 #define TEMP_DOWN 0
 
-#define TEMP_THRESHOLD 15 // 1.5 degrees
-#define SET_TEMP_TIMEOUT_TIME 2000
 #define WAIT_INIT_TIME 6000
-#define SENSE_INTERVAL 10000
+#define UI_QUEUE_LENGTH 8
 #define INIT_MESSAGE ((int[4]){11,14,14,15}) //todo: update charmap to allow more letters
 
-const uint RELAY_PIN = 0;
 const uint UP_PIN = 14;
 const uint DOWN_PIN = 12;
 const uint CYCLE_PIN = 9;
+// the Pico W's led is on the wifi chip, so there's no blinking on that
+#ifdef PICO_DEFAULT_LED_PIN
 const uint LED_PIN = PICO_DEFAULT_LED_PIN;
+#endif
+
+// one line per zone: its relay pin, and the mux channel its aht20 is on
+// (AHT20_NO_MUX if it's straight on the bus - at most one can be, since
+// they share an address). The buttons and display control zone 0
+struct zone_pins {
+    uint relay_pin;
+    int sensor_channel;
+};
+static const struct zone_pins zone_pins[] = {
+    {0, AHT20_NO_MUX},
+};
+#define ZONE_COUNT ((int)(sizeof(zone_pins) / sizeof(zone_pins[0])))
+
+static struct zone zones[ZONE_COUNT];
+static int zone_queue[ZONE_COUNT];
+static struct zone_scheduler scheduler;
+static uint32_t relay_mask = 0;
 
-static volatile int temperature_setting;
-static volatile int current_temperature;
-static volatile int current_humidity;
+static struct thermostat* const thermostat = &zones[0].thermostat;
 
-enum ui_state {
-    display_temp,
-    display_humid,
-    display_none,
+// relay runtime and comfort for each zone, see the "stats" command
+static struct accounting accounting[ZONE_COUNT];
+
+// setting for every zone by time of day, sorted by minute. Zones start
+// heating early for the next one, see optimal_start.h. Only used once the
+// time of day has been set with the "time" command, since there's no clock
+// that survives a reset. A button press holds until the next change
+static const struct schedule_entry schedule[] = {
+    {6*60 + 30, 700},
+    {22*60,     620},
 };
-static enum ui_state current_state;
-static bool user_setting_temp = false;
+#define SCHEDULE_COUNT ((int)(sizeof(schedule) / sizeof(schedule[0])))
+#define MS_PER_DAY (24 * 3600 * 1000)
+
+static bool clock_set = false;
+static uint32_t clock_offset;           // ms to add to the time since boot
+static int scheduled_setting[ZONE_COUNT];
+
+// button presses, timeouts and new readings go to the ui task through
+// ui_queue. It sends what to draw to the display task through
+// display_queue, which holds one request - a newer one replaces an older
+// one that hasn't been drawn yet, keeping the earliest button press time
+static QueueHandle_t ui_queue = NULL;
+static QueueHandle_t display_queue = NULL;
 
+// time from a button press being seen to the display being updated
+static struct latency_histogram button_latency;
 
 //timer stuff
 static TimerHandle_t screen_timeout_timer = NULL;
@@ -49,6 +93,7 @@ static TimerHandle_t wait_init_timer = NULL;
 
 //function declarations
 void manage_sensor();
+void send_ui_event(enum ui_event event);
 
 
 
@@ -60,13 +105,7 @@ void manage_sensor();
 // After user presses a button, and after this timer runs out, reset the 
 // display to show the current temp/humidity again
 void screen_timeout_callback(TimerHandle_t xTimer){
-    user_setting_temp = false;
-    if(current_state == display_temp) 
-        seven_seg_display_temp(current_temperature);
-    else if(current_state == display_humid) 
-        seven_seg_display_humidity(current_humidity); 
-    else if(current_state == display_none)
-        seven_seg_display_off();
+    send_ui_event(UI_EVENT_TIMEOUT);
 }
 
 // start the sensor only after the timer runs out
@@ -84,8 +123,10 @@ void start_sensor_callback(){
 void intialize_ios(){
     stdio_init_all();
     //initialize led pin    
+#ifdef PICO_DEFAULT_LED_PIN
     gpio_init(LED_PIN);
     gpio_set_dir(LED_PIN, GPIO_OUT);
+#endif
     //initialize buttons
     gpio_init(UP_PIN);
     gpio_init(DOWN_PIN);
@@ -96,42 +137,54 @@ void intialize_ios(){
     gpio_set_pulls(UP_PIN, true, false); 
     gpio_set_pulls(DOWN_PIN, true, false); 
     gpio_set_pulls(CYCLE_PIN, true, false); 
-    //initialize relay output
-    gpio_init(RELAY_PIN);
-    gpio_set_dir(RELAY_PIN, GPIO_OUT);
-    gpio_set_pulls(RELAY_PIN, false, true); //set pulldown resistor
-    gpio_put(RELAY_PIN, OFF); // make sure it's off to begin
+    //initialize relay outputs
+    for(int i=0; i<ZONE_COUNT; i++){
+        uint pin = zone_pins[i].relay_pin;
+        gpio_init(pin);
+        gpio_set_dir(pin, GPIO_OUT);
+        gpio_set_pulls(pin, false, true); //set pulldown resistor
+        gpio_put(pin, OFF); // make sure it's off to begin
+        relay_mask |= 1u << pin;
+    }
 }
 
 
 // initialize all stuffs
 void system_initialize(){
 
-    // variable inital values
-    current_state = display_temp;
-    temperature_setting = 700;
-    current_temperature = 999;
-    current_humidity = 99;
-    user_setting_temp = false;
+    // a sensor straight on the bus has to close the mux before it's read
+    // if any of the others are behind it
+    bool mux_present = false;
+    for(int i=0; i<ZONE_COUNT; i++){
+        if(zone_pins[i].sensor_channel != AHT20_NO_MUX) mux_present = true;
+    }
 
-    buffer_initialize(temperature_setting+20); //+20 so the relay doesn't turn on at first
+    // variable inital values
+    for(int i=0; i<ZONE_COUNT; i++){
+        thermostat_initialize(&zones[i].thermostat, 700);
+        zones[i].thermostat.sensor.mux_channel = zone_pins[i].sensor_channel;
+        zones[i].thermostat.sensor.mux_present = mux_present;
+        accounting_initialize(&accounting[i]);
+    }
+    zone_scheduler_initialize(&scheduler, zones, zone_queue, ZONE_COUNT, ZONE_STAGGER_TIME);
 
     //initialize buttons and relay pin
     intialize_ios();
 
     //initialize peripherals    
     i2c_module_initialize(); 
-    seven_seg_begin(); 
+    seven_seg_begin(&thermostat->display); 
 
     //after short delay
     vTaskDelay(20); 
     // aht20 needs some time to power up
-    aht20_initialize();
+    for(int i=0; i<ZONE_COUNT; i++)
+        aht20_initialize(&zones[i].thermostat.sensor);
     // don't take measurements until after some more time has passed
     xTimerStart(wait_init_timer, portMAX_DELAY);
 
     //display something fun while we wait for temperature reading
-    seven_seg_display_test(INIT_MESSAGE);
+    seven_seg_display_test(&thermostat->display, INIT_MESSAGE);
 
     // done initializing
     vTaskDelete(NULL);
@@ -144,43 +197,22 @@ void system_initialize(){
 /****************** Helper Functions *****************/
 /*****************************************************/
 
-// when the user presses the cycle button, switch between displaying 
-// temperature, humidity, and nothing
-static void cycle_display_state(){        
-
-    if(current_state==display_temp){
-        current_state = display_humid;
-        seven_seg_display_humidity(current_humidity); 
-    } 
-    
-    else if(current_state==display_humid){
-        current_state = display_none;
-        seven_seg_display_off();
-    } 
-    
-    else{
-        current_state = display_temp;
-        seven_seg_display_temp(current_temperature); 
-    } 
+// queue an event for the ui task. Never waits, so it's fine to call from
+// the timer callback and the input task
+void send_ui_event(enum ui_event event){
+    struct ui_message message = {event, time_us_32()};
+    xQueueSend(ui_queue, &message, 0);
 }
 
 
-
-// increase or decrease the temperature setting by temp_delta
-void change_temperature_setting(int temp_delta){
-    // I want first btn press to just show the setting, and subsequent
-    // presses to actually change the setting. So check if user_setting_temp
-    if(user_setting_temp){
-        //increase or decrease
-        temperature_setting += temp_delta;                
-    } else {
-        user_setting_temp = true;    
-    }
-
-    //show setting for a few seconds then return to actual temp                
-    xTimerStart(screen_timeout_timer, portMAX_DELAY);
-    seven_seg_display_temp(temperature_setting);
-    printf("temperature set to %d\n", temperature_setting);     
+// console command
+void print_button_latency(){
+    printf("button to display latency, %lu presses\n", (unsigned long)button_latency.total);
+    printf("p50 %luus  p90 %luus  p99 %luus  max %luus\n",
+        (unsigned long)latency_percentile(&button_latency, 50),
+        (unsigned long)latency_percentile(&button_latency, 90),
+        (unsigned long)latency_percentile(&button_latency, 99),
+        (unsigned long)button_latency.max);
 }
 
 
@@ -191,6 +223,7 @@ void change_temperature_setting(int temp_delta){
 /*****************************************************/
 
 // blink an LED.
+#ifdef PICO_DEFAULT_LED_PIN
 void led_task()
 {   
     while (true) {
@@ -201,35 +234,91 @@ void led_task()
         printf("blonk\n");
     }
 }
+#endif
+
+
+
+#if THERMOSTAT_WIFI
+static struct telemetry telemetry;
+
+// samples zone 0 every SENSE_INTERVAL and sends them to the broker in
+// batches. The only task that touches the wifi chip
+void telemetry_task(){
+    if(!net_initialize()){
+        printf("wifi chip didn't start\n");
+        vTaskDelete(NULL);
+    }
+    telemetry_initialize(&telemetry, SENSE_INTERVAL / 1000);
+
+    // wait for the first reading
+    vTaskDelay(WAIT_INIT_TIME + SENSE_INTERVAL);
+    TickType_t last_wake = xTaskGetTickCount();
+
+    while(true){
+        struct telemetry_sample sample = {
+            time_us_64() / 1000000,
+            thermostat_get_temperature(thermostat),
+            thermostat_get_humidity(thermostat),
+            thermostat_get_setting(thermostat),
+            zones[0].output,
+        };
+        if(telemetry_add(&telemetry, &sample)){
+            int setting = telemetry_send(&telemetry, MQTT_BROKER, MQTT_PORT);
+            if(setting){
+                thermostat_set_setting(thermostat, setting);
+                recorder_setting(setting);
+                printf("temperature set to %d remotely\n", setting);
+            }
+        }
+        vTaskDelayUntil(&last_wake, SENSE_INTERVAL);
+    }
+}
+
+// console command
+void print_telemetry(){
+    telemetry_print_stats(&telemetry);
+}
+#endif
 
 
 
 // repeatedly reads data and displays it 
 void manage_sensor(){
 
+    bool ok[ZONE_COUNT];
+
     while(true){
-        // trigger measurement
-        aht20_start_measurement();
+        // trigger every zone's measurement, so they can all convert at once
+        for(int i=0; i<ZONE_COUNT; i++)
+            ok[i] = aht20_start_measurement(&zones[i].thermostat.sensor);
         vTaskDelay(80);
-        // read measurement from i2c and calculate
-        aht20_read_measurement();
-
-        // retrieve measurements from module
-        int temp_reading = aht20_get_temp();
-        current_humidity = aht20_get_humidity();
-
-        buffer_append(temp_reading);
-        current_temperature = buffer_get_avg();
-
-        // update display
-        if(!user_setting_temp){
-            if(current_state == display_temp) 
-                seven_seg_display_temp(current_temperature);
-            if(current_state == display_humid) 
-                seven_seg_display_humidity(current_humidity); 
+
+        for(int i=0; i<ZONE_COUNT; i++){
+            struct thermostat* t = &zones[i].thermostat;
+
+            // read measurement from i2c and calculate
+            if(!ok[i] || !aht20_read_measurement(&t->sensor)){
+                // the i2c module has already cleared the bus if it needed
+                // to, so just try again next time
+                printf("zone %d aht20 not answering\n", i);
+                continue;
+            }
+
+            // record the raw frame so this run can be replayed later.
+            // replay only knows about one zone
+            if(i == 0){
+                uint8_t frame[AHT20_FRAME_LENGTH];
+                aht20_get_raw_frame(&t->sensor, frame);
+                recorder_aht20_frame(frame);
+            }
+
+            // average it in and update display
+            thermostat_new_reading(t);
+            if(i == 0) send_ui_event(UI_EVENT_SAMPLE);
+
+            printf("zone %d temp: \t%0.2fF\n", i, (float)thermostat_get_temperature(t)/10);
+            printf("zone %d humidity: \t%d%%\n\n", i, thermostat_get_humidity(t));
         }
-        printf("temp: \t\t%0.2fF\n", (float)current_temperature/10);
-        printf("humidity: \t%d%%\n\n", current_humidity);
         
         // delay until next time
         vTaskDelay(SENSE_INTERVAL-80);
@@ -239,35 +328,179 @@ void manage_sensor(){
 
 
 
-// checks if the temperature setting is above or below the actual temperature
-// and sets the relay accordingly
+// learns how each zone heats, and moves its setting when the schedule
+// says so - or earlier, if it needs to start heating to be there in time
+static void follow_schedule(uint64_t now){
+    for(int i=0; i<ZONE_COUNT; i++){
+        struct thermostat* t = &zones[i].thermostat;
+        optimal_start_update(&t->model, now, thermostat_get_temperature(t), zones[i].output);
+    }
+    if(!clock_set) return;
+
+    uint32_t second_of_day = (uint32_t)((now + clock_offset) % MS_PER_DAY) / 1000;
+    for(int i=0; i<ZONE_COUNT; i++){
+        struct thermostat* t = &zones[i].thermostat;
+        int setting = optimal_start_setting(&t->model, schedule, SCHEDULE_COUNT,
+                                            second_of_day, thermostat_get_temperature(t));
+        if(setting != scheduled_setting[i]){
+            scheduled_setting[i] = setting;
+            thermostat_set_setting(t, setting);
+            if(i == 0) recorder_setting(setting);
+            printf("zone %d schedule set %d\n", i, setting);
+        }
+    }
+}
+
+
+// checks every zone's temperature against its setting and sets the relays
+// accordingly. The scheduler staggers them switching on
 void manage_relay(){
         
-    static int relay_state = OFF;
+    static uint32_t relay_values = 0;
 
     while(true){
-        if (relay_state == OFF){
-            if(current_temperature < (temperature_setting)){
-                relay_state = ON;       
-                gpio_put(RELAY_PIN, relay_state);                 
-                printf("relay on\n");
-            } 
-        }
-        else {
-            if (current_temperature > (temperature_setting + TEMP_THRESHOLD)){
-                relay_state = OFF;
-                gpio_put(RELAY_PIN, relay_state);    
-                printf("relay off\n");
+        // 64 bits for the time of day, since 2^32 ms isn't a whole number
+        // of days. Everything else only looks at differences
+        uint64_t time = time_us_64() / 1000;
+        uint32_t now = time;
+        follow_schedule(time);
+
+        if(zone_scheduler_tick(&scheduler, now)){
+            uint32_t new_values = 0;
+            for(int i=0; i<ZONE_COUNT; i++){
+                if(zones[i].output == ON) new_values |= 1u << zone_pins[i].relay_pin;
+            }
+            // all the relays in one write
+            gpio_put_masked(relay_mask, new_values);
+
+            for(int i=0; i<ZONE_COUNT; i++){
+                uint32_t bit = 1u << zone_pins[i].relay_pin;
+                if((new_values & bit) == (relay_values & bit)) continue;
+                if(i == 0) recorder_relay(zones[i].output);
+                printf(zones[i].output == ON ? "zone %d relay on\n" : "zone %d relay off\n", i);
             }
+            relay_values = new_values;
+        }
+
+        for(int i=0; i<ZONE_COUNT; i++){
+            struct thermostat* t = &zones[i].thermostat;
+            accounting_sample(&accounting[i], now, thermostat_get_temperature(t), thermostat_get_humidity(t),
+                              thermostat_get_setting(t), t->threshold, zones[i].output == ON);
         }
         
-        vTaskDelay(1000);
+        vTaskDelay(RELAY_INTERVAL);
+    }
+}
+
+
+
+// console command: "time 18:45" sets the time of day for the schedule
+void set_time(const char* args){
+    int hours, minutes;
+    if(sscanf(args, "%d:%d", &hours, &minutes) != 2 || hours < 0 || hours > 23 || minutes < 0 || minutes > 59){
+        printf("usage: time hh:mm\n");
+        return;
+    }
+    uint32_t now = (time_us_64() / 1000) % MS_PER_DAY;
+    uint32_t wanted = (hours * 60 + minutes) * 60 * 1000;
+    clock_offset = (wanted + MS_PER_DAY - now) % MS_PER_DAY;
+    // apply whatever the schedule says for now straight away
+    for(int i=0; i<ZONE_COUNT; i++) scheduled_setting[i] = 0;
+    clock_set = true;
+}
+
+
+// console command
+void print_heating_models(){
+    for(int i=0; i<ZONE_COUNT; i++){
+        const struct heating_model* m = &zones[i].thermostat.model;
+        printf("zone %d: heats %0.1fF/h (%d periods), cools %0.1fF/h (%d periods)\n", i,
+            (float)m->heating_rate/10, m->heating_periods,
+            (float)m->cooling_rate/10, m->cooling_periods);
+    }
+}
+
+
+// console command
+void print_stats(){
+    for(int i=0; i<ZONE_COUNT; i++){
+        printf("zone %d: ", i);
+        accounting_print(&accounting[i]);
+    }
+}
+
+
+// console command
+void print_zones(){
+    for(int i=0; i<ZONE_COUNT; i++){
+        struct zone* z = &zones[i];
+        printf("zone %d: %0.1fF set %0.1fF, %d%%, relay %s%s\n", i,
+            (float)thermostat_get_temperature(&z->thermostat)/10,
+            (float)thermostat_get_setting(&z->thermostat)/10,
+            thermostat_get_humidity(&z->thermostat),
+            z->output == ON ? "on" : "off",
+            z->waiting ? " (waiting)" : "");
+    }
+}
+
+
+
+// replaces whatever's waiting for the display task. A button press in the
+// one being replaced only gets seen once this one is drawn, so its time
+// is carried over, otherwise the slowest presses would never be measured.
+// Taking the old one out rather than peeking means the display task can't
+// have drawn it in between
+static void send_display_request(struct display_request* request){
+    struct display_request pending;
+    if(xQueueReceive(display_queue, &pending, 0) == pdTRUE && pending.from_button){
+        if(!request->from_button || (int32_t)(pending.event_time - request->event_time) < 0)
+            request->event_time = pending.event_time;
+        request->from_button = true;
+    }
+    xQueueOverwrite(display_queue, request);
+}
+
+
+// handles button presses, timeouts and new readings one at a time, and
+// passes anything that needs drawing on to the display task
+void ui_task(){
+    struct ui_message message;
+    struct display_request request;
+
+    while(true){
+        xQueueReceive(ui_queue, &message, portMAX_DELAY);
+
+        //show setting for a few seconds then return to actual temp
+        if(ui_handle_event(thermostat, &message, &request))
+            xTimerStart(screen_timeout_timer, portMAX_DELAY);
+
+        if(request.kind != DISPLAY_NOTHING)
+            send_display_request(&request);
+
+        if(message.event == UI_EVENT_UP || message.event == UI_EVENT_DOWN)
+            printf("temperature set to %d\n", thermostat_get_setting(thermostat));
     }
 }
 
 
 
-// Checks for button presses and performs the actions
+// the only task that writes to the display after startup, so slow i2c
+// writes never hold up the buttons
+void display_task(){
+    struct display_request request;
+
+    while(true){
+        xQueueReceive(display_queue, &request, portMAX_DELAY);
+        ui_show(&thermostat->display, &request);
+
+        if(request.from_button)
+            latency_record(&button_latency, time_us_32() - request.event_time);
+    }
+}
+
+
+
+// Checks for button presses and sends them to the ui task
 void get_inputs(){
     // maybe try using hardware interrupts instead of this
     // https://raspberrypi.github.io/pico-sdk-doxygen/group__hardware__gpio.html#ga6347e27da3ab34f1ea65b5ae16ab724f
@@ -280,18 +513,21 @@ void get_inputs(){
         //check if buttons have been pressed
         if(up_btn_state == BTN_RELEASED && gpio_get(UP_PIN) == BTN_PRESSED){
             up_btn_state = BTN_PRESSED;            
-            change_temperature_setting(10);
+            recorder_button(BUTTON_UP);
+            send_ui_event(UI_EVENT_UP);
         }
 
         if(down_btn_state == BTN_RELEASED && gpio_get(DOWN_PIN) == BTN_PRESSED){
             down_btn_state = BTN_PRESSED;            
-            change_temperature_setting(-10);
+            recorder_button(BUTTON_DOWN);
+            send_ui_event(UI_EVENT_DOWN);
         }
         
         if(cycle_btn_state == BTN_RELEASED && gpio_get(CYCLE_PIN) == BTN_PRESSED){
             cycle_btn_state = BTN_PRESSED;
             //do cycle button stuff
-            cycle_display_state();            
+            recorder_button(BUTTON_CYCLE);
+            send_ui_event(UI_EVENT_CYCLE);
         }
 
         //check if buttons have been released
@@ -319,6 +555,21 @@ void get_inputs(){
 
 int main()
 {
+    /* Create Queues */
+
+    ui_queue = xQueueCreate(UI_QUEUE_LENGTH, sizeof(struct ui_message));
+    display_queue = xQueueCreate(1, sizeof(struct display_request));
+    latency_reset(&button_latency);
+    console_add_command("latency", "button to display latency", print_button_latency);
+    console_add_command("i2c", "i2c errors and transaction times", i2c_module_print_stats);
+    console_add_command("zones", "each zone's temperature, setting and relay", print_zones);
+    console_add_command_with_args("time", "set the time of day, hh:mm", set_time);
+    console_add_command("heating", "learned heating and cooling rates", print_heating_models);
+    console_add_command("stats", "relay runtime, duty cycle and comfort", print_stats);
+#if THERMOSTAT_WIFI
+    console_add_command("mqtt", "telemetry counters", print_telemetry);
+#endif
+
     /* Create Timers */
 
     //timer for set temp. When the user presses up or down button, the
@@ -344,6 +595,7 @@ int main()
 
     /* Create Tasks */
 
+#ifdef PICO_DEFAULT_LED_PIN
     xTaskCreate(
                     led_task,    // Function that implements the task. 
                     "LED_Task",  // Text name for the task. 
@@ -351,10 +603,19 @@ int main()
                     NULL,        // Parameter passed into the task. 
                     1,           // Priority at which the task is created. 
                     NULL );      // Used to pass out the created task's handle. 
+#endif
 
     xTaskCreate(system_initialize, "system_initialize", 256, NULL, 5, NULL);
     xTaskCreate(get_inputs, "get_inputs", 256, NULL, 2, NULL);
-    xTaskCreate(manage_relay, "manage_relay", 256, NULL, 1, NULL);
+    xTaskCreate(ui_task, "ui", 256, NULL, 2, NULL);
+    xTaskCreate(display_task, "display", 256, NULL, 1, NULL);
+    // the schedule, learning and accounting run on every relay tick, and the
+    // console commands print floats. "stack" shows how much is left
+    xTaskCreate(manage_relay, "manage_relay", 512, NULL, 1, NULL);
+    xTaskCreate(console_task, "console", 512, NULL, 1, NULL);
+#if THERMOSTAT_WIFI
+    xTaskCreate(telemetry_task, "telemetry", 1024, NULL, 1, NULL);
+#endif
     
     
     vTaskStartScheduler();
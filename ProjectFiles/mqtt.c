@@ -0,0 +1,182 @@
+#include "mqtt.h"
+#include "net.h"
+#include <string.h>
+
+
+#define CONNECT     0x10
+#define CONNACK     0x20
+#define PUBLISH     0x30
+#define SUBSCRIBE   0x82        // low bits are fixed at 2 for subscribe
+#define SUBACK      0x90
+#define DISCONNECT  0xE0
+
+#define TYPE_MASK   0xF0
+#define RETAIN      0x01
+#define QOS_MASK    0x06
+#define CLEAN_SESSION 0x02
+#define PROTOCOL_LEVEL 4        // 3.1.1
+#define SUBSCRIBE_ID 1
+
+
+
+static int put_length(uint8_t* p, int length){
+    int n = 0;
+    do {
+        uint8_t byte = length % 128;
+        length /= 128;
+        if(length > 0) byte |= 0x80;
+        p[n++] = byte;
+    } while(length > 0);
+    return n;
+}
+
+static int put_string(uint8_t* p, const char* s, int length){
+    p[0] = length >> 8;
+    p[1] = length;
+    memcpy(p + 2, s, length);
+    return length + 2;
+}
+
+
+// reads exactly length bytes, unless the connection goes or nothing arrives
+// for timeout_ms
+static bool read_exact(uint8_t* data, int length, uint32_t timeout_ms){
+    while(length > 0){
+        int n = net_receive(data, length, timeout_ms);
+        if(n <= 0) return false;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+
+// reads one packet into the buffer. Returns the first header byte, 0 if
+// nothing came, or -1 if the connection has gone. Packets too big for the
+// buffer are read and thrown away, and come back with length 0
+static int read_packet(struct mqtt_client* c, uint32_t timeout_ms, int* length){
+    uint8_t header;
+    int n = net_receive(&header, 1, timeout_ms);
+    if(n <= 0) return n;
+
+    int remaining = 0;
+    for(int shift=0; shift<28; shift+=7){
+        uint8_t byte;
+        if(!read_exact(&byte, 1, timeout_ms)) return -1;
+        remaining |= (byte & 0x7F) << shift;
+        if(!(byte & 0x80)) break;
+    }
+
+    if(remaining > MQTT_BUFFER_SIZE){
+        while(remaining > 0){
+            int chunk = remaining > MQTT_BUFFER_SIZE ? MQTT_BUFFER_SIZE : remaining;
+            if(!read_exact(c->buffer, chunk, timeout_ms)) return -1;
+            remaining -= chunk;
+        }
+        *length = 0;
+        return header;
+    }
+    if(!read_exact(c->buffer, remaining, timeout_ms)) return -1;
+    *length = remaining;
+    return header;
+}
+
+
+static void handle_publish(struct mqtt_client* c, uint8_t header, int length){
+    if(length < 2) return;
+    int topic_length = (c->buffer[0] << 8) | c->buffer[1];
+    int start = 2 + topic_length;
+    if((header & QOS_MASK) != 0) start += 2;        // packet id
+    if(start > length || topic_length >= MQTT_TOPIC_LENGTH) return;
+
+    char topic[MQTT_TOPIC_LENGTH];
+    memcpy(topic, c->buffer + 2, topic_length);
+    topic[topic_length] = 0;
+    if(c->on_message)
+        c->on_message(topic, c->buffer + start, length - start, c->context);
+}
+
+
+// handles packets until one of type arrives. Returns its length, or -1
+static int wait_for(struct mqtt_client* c, uint8_t type, uint32_t timeout_ms){
+    while(true){
+        int length;
+        int header = read_packet(c, timeout_ms, &length);
+        if(header <= 0) return -1;
+        if((header & TYPE_MASK) == type) return length;
+        if((header & TYPE_MASK) == PUBLISH) handle_publish(c, header, length);
+    }
+}
+
+
+
+bool mqtt_connect(struct mqtt_client* c, const char* host, int port, uint32_t timeout_ms){
+    if(!net_connect(host, port, timeout_ms)) return false;
+
+    int id_length = strlen(c->client_id);
+    uint8_t* p = c->buffer;
+    int n = 0;
+    p[n++] = CONNECT;
+    n += put_length(p + n, 10 + 2 + id_length);
+    n += put_string(p + n, "MQTT", 4);
+    p[n++] = PROTOCOL_LEVEL;
+    p[n++] = CLEAN_SESSION;
+    p[n++] = MQTT_KEEPALIVE >> 8;
+    p[n++] = MQTT_KEEPALIVE & 0xFF;
+    n += put_string(p + n, c->client_id, id_length);
+
+    if(net_send(p, n) != n || wait_for(c, CONNACK, timeout_ms) != 2 || c->buffer[1] != 0){
+        net_close();
+        return false;
+    }
+    return true;
+}
+
+
+bool mqtt_subscribe(struct mqtt_client* c, const char* topic, uint32_t timeout_ms){
+    int topic_length = strlen(topic);
+    uint8_t* p = c->buffer;
+    int n = 0;
+    p[n++] = SUBSCRIBE;
+    n += put_length(p + n, 2 + 2 + topic_length + 1);
+    p[n++] = SUBSCRIBE_ID >> 8;
+    p[n++] = SUBSCRIBE_ID & 0xFF;
+    n += put_string(p + n, topic, topic_length);
+    p[n++] = 0;         // qos 0
+
+    if(net_send(p, n) != n) return false;
+    return wait_for(c, SUBACK, timeout_ms) >= 3 && c->buffer[2] != 0x80;
+}
+
+
+bool mqtt_publish(struct mqtt_client* c, const char* topic, const uint8_t* payload, int length, bool retain){
+    int topic_length = strlen(topic);
+    uint8_t* p = c->buffer;
+    int n = 0;
+    p[n++] = PUBLISH | (retain ? RETAIN : 0);
+    n += put_length(p + n, 2 + topic_length + length);
+    n += put_string(p + n, topic, topic_length);
+
+    // payload straight from the caller, so it doesn't have to fit the buffer
+    if(net_send(p, n) != n) return false;
+    return length == 0 || net_send(payload, length) == length;
+}
+
+
+void mqtt_poll(struct mqtt_client* c, uint32_t timeout_ms){
+    while(true){
+        int length;
+        int header = read_packet(c, timeout_ms, &length);
+        if(header <= 0) return;
+        if((header & TYPE_MASK) == PUBLISH) handle_publish(c, header, length);
+    }
+}
+
+
+void mqtt_disconnect(struct mqtt_client* c){
+    uint8_t* p = c->buffer;
+    p[0] = DISCONNECT;
+    p[1] = 0;
+    net_send(p, 2);
+    net_close();
+}
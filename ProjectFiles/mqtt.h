@@ -0,0 +1,39 @@
+#ifndef MQTT_H
+#define MQTT_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+
+// Minimal MQTT 3.1.1 client on top of net.h: connect, subscribe and
+// publish at QoS 0, which is all the telemetry needs. Nothing runs in the
+// background - incoming messages are only handled inside these calls.
+
+#define MQTT_BUFFER_SIZE 256
+#define MQTT_TOPIC_LENGTH 64
+#define MQTT_KEEPALIVE 60       // seconds. We never stay connected that long
+
+struct mqtt_client {
+    const char* client_id;
+    // called for each message received. payload isn't null terminated
+    void (*on_message)(const char* topic, const uint8_t* payload, int length, void* context);
+    void* context;
+    uint8_t buffer[MQTT_BUFFER_SIZE];
+};
+
+
+bool mqtt_connect(struct mqtt_client* c, const char* host, int port, uint32_t timeout_ms);
+
+// waits for the broker to acknowledge. Retained messages for the topic
+// usually come just after, so poll for a moment afterwards
+bool mqtt_subscribe(struct mqtt_client* c, const char* topic, uint32_t timeout_ms);
+
+bool mqtt_publish(struct mqtt_client* c, const char* topic, const uint8_t* payload, int length, bool retain);
+
+// handles anything that arrives until nothing has for timeout_ms
+void mqtt_poll(struct mqtt_client* c, uint32_t timeout_ms);
+
+void mqtt_disconnect(struct mqtt_client* c);
+
+
+#endif
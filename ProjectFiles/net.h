@@ -0,0 +1,36 @@
+#ifndef NET_H
+#define NET_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+
+// Just enough networking for the mqtt client: one tcp connection at a
+// time, and turning the radio on and off around it. net_lwip.c is the
+// Pico W one; the PC build has one on posix sockets so the mqtt and
+// telemetry code can be tested against a local broker.
+//
+// All of these must be called from the same task.
+
+bool net_initialize();
+
+// radio powered on and joined to the network
+bool net_up(uint32_t timeout_ms);
+
+// radio powered off. Closes the connection if it's still open
+void net_down();
+
+// host is an IP address, e.g. "192.168.1.10"
+bool net_connect(const char* host, int port, uint32_t timeout_ms);
+
+// returns length, or -1 if the connection has gone
+int net_send(const uint8_t* data, int length);
+
+// waits up to timeout_ms for anything to arrive. Returns the number of
+// bytes read, 0 if nothing came, or -1 if the connection has gone
+int net_receive(uint8_t* data, int length, uint32_t timeout_ms);
+
+void net_close();
+
+
+#endif
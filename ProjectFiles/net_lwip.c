@@ -0,0 +1,159 @@
+#include "net.h"
+#include <FreeRTOS.h>
+#include <task.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/cyw43_arch.h"
+#include "lwip/tcp.h"
+#include "lwip/ip_addr.h"
+
+
+// Pico W. cyw43 and lwIP are built for polling (pico_cyw43_arch_lwip_poll)
+// since this FreeRTOS isn't the SDK's port, so nothing happens on the
+// network except inside these calls, and they must all come from one task.
+// The chip is only powered while the radio is up: net_up() starts it from
+// scratch and net_down() shuts it down again, firmware and all.
+
+#define RECEIVE_BUFFER 512
+#define POLL_TIME 1     // ticks between polls while waiting
+
+
+static struct tcp_pcb* pcb = NULL;
+static bool powered = false;
+static bool connected = false;
+static bool closed = false;
+static uint8_t received[RECEIVE_BUFFER];
+static int received_start = 0;
+static int received_length = 0;
+
+
+
+static err_t on_connected(void* arg, struct tcp_pcb* tpcb, err_t err){
+    connected = err == ERR_OK;
+    return ERR_OK;
+}
+
+
+static err_t on_receive(void* arg, struct tcp_pcb* tpcb, struct pbuf* p, err_t err){
+    if(!p){
+        closed = true;
+        return ERR_OK;
+    }
+
+    // move what's left to the front, then copy in as much as fits. The
+    // packets we care about are small; anything past that is dropped
+    memmove(received, received + received_start, received_length);
+    received_start = 0;
+    int room = RECEIVE_BUFFER - received_length;
+    int copied = pbuf_copy_partial(p, received + received_length, room < p->tot_len ? room : p->tot_len, 0);
+    received_length += copied;
+
+    tcp_recved(tpcb, p->tot_len);
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+
+static void on_error(void* arg, err_t err){
+    // lwIP has already freed the pcb
+    pcb = NULL;
+    closed = true;
+}
+
+
+// polls until done() or timeout. Returns done()
+static bool wait(bool (*done)(), uint32_t timeout_ms){
+    uint32_t start = to_ms_since_boot(get_absolute_time());
+    while(!done()){
+        cyw43_arch_poll();
+        if(to_ms_since_boot(get_absolute_time()) - start >= timeout_ms) return done();
+        vTaskDelay(POLL_TIME);
+    }
+    return true;
+}
+
+static bool is_connected(){ return connected || closed; }
+static bool has_data(){ return received_length > 0 || closed; }
+
+
+
+// makes sure the chip is there, then powers it off until the first net_up()
+bool net_initialize(){
+    if(cyw43_arch_init() != 0) return false;
+    cyw43_arch_deinit();
+    return true;
+}
+
+
+bool net_up(uint32_t timeout_ms){
+    if(!powered){
+        if(cyw43_arch_init() != 0) return false;
+        powered = true;
+    }
+    cyw43_arch_enable_sta_mode();
+    return cyw43_arch_wifi_connect_timeout_ms(WIFI_SSID, WIFI_PASSWORD,
+                                              CYW43_AUTH_WPA2_AES_PSK, timeout_ms) == 0;
+}
+
+
+void net_down(){
+    if(!powered) return;
+    // lwIP goes down with the chip, so nothing can be left open
+    net_close();
+    cyw43_arch_deinit();
+    powered = false;
+}
+
+
+bool net_connect(const char* host, int port, uint32_t timeout_ms){
+    ip_addr_t address;
+    if(!ipaddr_aton(host, &address)) return false;
+
+    pcb = tcp_new_ip_type(IPADDR_TYPE_V4);
+    if(!pcb) return false;
+    connected = false;
+    closed = false;
+    received_start = 0;
+    received_length = 0;
+
+    tcp_recv(pcb, on_receive);
+    tcp_err(pcb, on_error);
+    if(tcp_connect(pcb, &address, port, on_connected) != ERR_OK || !wait(is_connected, timeout_ms) || !connected){
+        net_close();
+        return false;
+    }
+    return true;
+}
+
+
+int net_send(const uint8_t* data, int length){
+    if(!pcb || closed) return -1;
+    if(tcp_write(pcb, data, length, TCP_WRITE_FLAG_COPY) != ERR_OK) return -1;
+    if(tcp_output(pcb) != ERR_OK) return -1;
+    cyw43_arch_poll();
+    return length;
+}
+
+
+int net_receive(uint8_t* data, int length, uint32_t timeout_ms){
+    wait(has_data, timeout_ms);
+    if(received_length == 0) return closed ? -1 : 0;
+
+    int n = received_length < length ? received_length : length;
+    memcpy(data, received + received_start, n);
+    received_start += n;
+    received_length -= n;
+    return n;
+}
+
+
+void net_close(){
+    if(pcb){
+        tcp_recv(pcb, NULL);
+        tcp_err(pcb, NULL);
+        if(tcp_close(pcb) != ERR_OK) tcp_abort(pcb);
+        pcb = NULL;
+    }
+    // give the fin a chance to go before the radio goes off
+    if(powered) cyw43_arch_poll();
+}
@@ -0,0 +1,118 @@
+#include "optimal_start.h"
+#include "thermostat.h"
+
+#define SECONDS_PER_DAY 86400
+
+
+
+void optimal_start_initialize(struct heating_model* m){
+    m->period_start = 0;
+    m->period_temperature = 0;
+    m->heating_rate = OPTIMAL_START_DEFAULT_HEATING;
+    m->cooling_rate = OPTIMAL_START_DEFAULT_COOLING;
+    m->heating_periods = 0;
+    m->cooling_periods = 0;
+    m->relay_state = 0;
+    m->started = false;
+    m->preheat_minute = -1;
+}
+
+
+// moves rate towards a new measurement. The first one replaces the default
+static uint16_t average_in(uint16_t rate, int32_t measured, uint8_t* periods){
+    if(measured < 1) measured = 1;
+    if(measured > UINT16_MAX) measured = UINT16_MAX;
+
+    if(*periods < UINT8_MAX) (*periods)++;
+    if(*periods == 1) return measured;
+    return rate + (measured - (int32_t)rate) / OPTIMAL_START_WEIGHT;
+}
+
+
+void optimal_start_update(struct heating_model* m, uint32_t now, int temperature, int relay_state){
+    relay_state = relay_state == ON;
+
+    if(!m->started || !AHT20_VALID_TEMPERATURE(m->period_temperature)){
+        m->started = true;
+        m->period_start = now;
+        m->period_temperature = temperature;
+        m->relay_state = relay_state;
+        return;
+    }
+    if(relay_state == m->relay_state) return;
+
+    // a period just ended. Measure it if it was long enough
+    uint32_t duration = now - m->period_start;
+    if(duration >= OPTIMAL_START_MIN_PERIOD && AHT20_VALID_TEMPERATURE(temperature)){
+        int32_t change = temperature - m->period_temperature;
+        int32_t per_hour = change * 3600 / (int32_t)(duration / 1000);
+
+        if(m->relay_state == ON && per_hour > 0)
+            m->heating_rate = average_in(m->heating_rate, per_hour, &m->heating_periods);
+        else if(m->relay_state != ON && per_hour < 0)
+            m->cooling_rate = average_in(m->cooling_rate, -per_hour, &m->cooling_periods);
+    }
+
+    m->period_start = now;
+    m->period_temperature = temperature;
+    m->relay_state = relay_state;
+}
+
+
+
+uint32_t optimal_start_lead_time(const struct heating_model* m, int from, int to){
+    if(to <= from) return 0;
+    return (uint32_t)(to - from) * 3600 / m->heating_rate;
+}
+
+
+// waiting w seconds the room drifts to from - cooling*w, then needs
+// (to - from + cooling*w) / heating to get there. Setting that to
+// due - w and solving:
+//   w = (due*heating - (to - from)*3600) / (heating + cooling)
+uint32_t optimal_start_wait_time(const struct heating_model* m, int from, int to, uint32_t due){
+    int64_t ahead = (int64_t)due * m->heating_rate - (int64_t)(to - from) * 3600;
+    if(ahead <= 0) return 0;
+    return ahead / (m->heating_rate + m->cooling_rate);
+}
+
+
+
+int optimal_start_schedule_setting(const struct schedule_entry* schedule, int count, uint32_t second_of_day){
+    uint32_t minute = second_of_day / 60;
+
+    // before the first entry of the day, yesterday's last one still applies
+    int setting = schedule[count-1].setting;
+    for(int i=0; i<count && schedule[i].minute <= minute; i++){
+        setting = schedule[i].setting;
+    }
+    return setting;
+}
+
+
+int optimal_start_setting(struct heating_model* m, const struct schedule_entry* schedule,
+                          int count, uint32_t second_of_day, int temperature){
+    if(count == 0) return 0;
+
+    int setting = optimal_start_schedule_setting(schedule, count, second_of_day);
+
+    // the next change, which might be tomorrow
+    int next = 0;
+    while(next < count && (uint32_t)schedule[next].minute * 60 <= second_of_day) next++;
+    uint32_t due = next < count ? schedule[next].minute * 60 - second_of_day
+                                : SECONDS_PER_DAY - second_of_day + schedule[0].minute * 60;
+    int target = schedule[next % count].setting;
+
+    // already heating early for it. Going back to setting once the room
+    // gets there would just flip back and forth until it's due
+    if(m->preheat_minute == schedule[next % count].minute && due <= OPTIMAL_START_MAX_LEAD)
+        return target;
+    m->preheat_minute = -1;
+
+    if(!AHT20_VALID_TEMPERATURE(temperature)) return setting;
+    if(target <= setting || target <= temperature) return setting;
+    if(due > OPTIMAL_START_MAX_LEAD) return setting;
+    if(optimal_start_wait_time(m, temperature, target, due) > 0) return setting;
+    m->preheat_minute = schedule[next % count].minute;
+    return target;
+}
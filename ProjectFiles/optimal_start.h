@@ -0,0 +1,67 @@
+#ifndef OPTIMAL_START_H
+#define OPTIMAL_START_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+
+// Learns how fast a room heats up and cools down, and uses it to start
+// heating early enough that the room reaches a scheduled setting right at
+// the scheduled time instead of starting then.
+//
+// Rates are measured over whole relay on and off periods (the 10th of a
+// degree readings are too coarse to get a slope from a couple of samples)
+// and averaged in with a weight of 1/OPTIMAL_START_WEIGHT. They're in 10ths
+// of a degree per hour, like everything else in 10ths.
+
+#define OPTIMAL_START_MIN_PERIOD (5 * 60 * 1000)   // ms. shorter periods are ignored
+#define OPTIMAL_START_WEIGHT 4
+#define OPTIMAL_START_DEFAULT_HEATING 100          // 10 degrees an hour
+#define OPTIMAL_START_DEFAULT_COOLING 20
+#define OPTIMAL_START_MAX_LEAD (4 * 3600)          // seconds. never start earlier than this
+
+struct heating_model {
+    uint32_t period_start;      // ms
+    int16_t period_temperature;
+    uint16_t heating_rate;      // net rise with the heater on
+    uint16_t cooling_rate;      // fall with it off
+    uint8_t heating_periods;    // how many went into each rate, up to 255
+    uint8_t cooling_periods;
+    uint8_t relay_state;
+    bool started;
+    int16_t preheat_minute;     // the change it's started heating early for, or -1
+};
+
+// minute is the minute of the day. A schedule is sorted by minute and each
+// setting lasts until the next one, wrapping round midnight
+struct schedule_entry {
+    uint16_t minute;
+    int16_t setting;
+};
+
+
+void optimal_start_initialize(struct heating_model* m);
+
+// call every relay tick with the averaged temperature and what the relay
+// is actually doing
+void optimal_start_update(struct heating_model* m, uint32_t now, int temperature, int relay_state);
+
+// seconds of heating to get from one temperature to another
+uint32_t optimal_start_lead_time(const struct heating_model* m, int from, int to);
+
+// seconds until the room would be at temperature to if it started heating
+// after drifting down from from until then - so the best time to start
+// for a change due in due seconds. 0 means start now
+uint32_t optimal_start_wait_time(const struct heating_model* m, int from, int to, uint32_t due);
+
+int optimal_start_schedule_setting(const struct schedule_entry* schedule, int count, uint32_t second_of_day);
+
+// the setting to use now: the scheduled one, or the next one if it's
+// higher and it's time to start heating for it. Once it's started heating
+// early it sticks with the next setting until that's due, even if the room
+// gets there first
+int optimal_start_setting(struct heating_model* m, const struct schedule_entry* schedule,
+                          int count, uint32_t second_of_day, int temperature);
+
+
+#endif
@@ -0,0 +1,34 @@
+#include "recorder.h"
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "aht20.h"
+
+
+
+static uint32_t now_ms(){
+    return to_ms_since_boot(get_absolute_time());
+}
+
+
+void recorder_aht20_frame(const uint8_t* frame){
+    printf("%c%lu %c ", RECORD_PREFIX, (unsigned long)now_ms(), RECORD_AHT20);
+    for (int i=0; i<AHT20_FRAME_LENGTH; i++){
+        printf("%02x", frame[i]);
+    }
+    printf("\n");
+}
+
+
+void recorder_button(char button){
+    printf("%c%lu %c %c\n", RECORD_PREFIX, (unsigned long)now_ms(), RECORD_BUTTON, button);
+}
+
+
+void recorder_relay(int relay_state){
+    printf("%c%lu %c %d\n", RECORD_PREFIX, (unsigned long)now_ms(), RECORD_RELAY, relay_state);
+}
+
+
+void recorder_setting(int setting){
+    printf("%c%lu %c %d\n", RECORD_PREFIX, (unsigned long)now_ms(), RECORD_SETTING, setting);
+}
@@ -0,0 +1,42 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "stdint.h"
+
+
+// Prints sensor frames, button presses, relay changes and settings changed
+// by anything other than the buttons over usb serial so a run can be
+// captured and replayed on a PC (see Host/replay.c). Every record is one
+// line:
+//
+//   @<ms since boot> A <6 raw aht20 bytes in hex>
+//   @<ms since boot> B <U, D or C>
+//   @<ms since boot> R <0 or 1>
+//   @<ms since boot> S <setting, 10ths of a degree>
+//
+// Anything else in the serial log (not starting with @) is ignored by
+// the replay tool.
+
+#define RECORD_PREFIX '@'
+#define RECORD_AHT20 'A'
+#define RECORD_BUTTON 'B'
+#define RECORD_RELAY 'R'
+#define RECORD_DISPLAY 'D'
+#define RECORD_SETTING 'S'
+
+#define BUTTON_UP 'U'
+#define BUTTON_DOWN 'D'
+#define BUTTON_CYCLE 'C'
+
+
+void recorder_aht20_frame(const uint8_t* frame);
+
+void recorder_button(char button);
+
+void recorder_relay(int relay_state);
+
+// from the schedule or over the network
+void recorder_setting(int setting);
+
+
+#endif
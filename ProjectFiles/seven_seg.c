@@ -1,9 +1,6 @@
 // Adapted from https://github.com/RobTillaart/HT16K33
 
 #include "seven_seg.h"
-#include "hardware/i2c.h"
-#include "pico/stdlib.h"
-#include "pico/binary_info.h"
 #include "i2c_module.h"
 
 
@@ -52,91 +49,87 @@ static const uint8_t charmap[CHARMAP_LENGTH] = {  // TODO PROGMEM ?
 #define LETTER_H 0x74
 
 
-static uint8_t displaycache[5] = {0,0,0,0,0};
-static bool display_is_on = false;
-
-
-
-static void refresh()
+static void refresh(struct seven_seg* display)
 {
     // turn on the display if it isn't already
-    if(!display_is_on)
-        seven_seg_display_on();
+    if(!display->display_is_on)
+        seven_seg_display_on(display);
 
     // put characters from displaycache on the screen
     for (uint8_t pos = 0; pos <= 4; pos++)
     {
-        uint8_t buffer[2] = {(pos * 2), displaycache[pos]};
+        uint8_t buffer[2] = {(pos * 2), display->displaycache[pos]};
         i2c_module_send(HT16K33_ADDRESS, buffer, 2);
     }
 }
 
 
-bool seven_seg_begin(){    
+bool seven_seg_begin(struct seven_seg* display){    
 
-    int ret;
     uint8_t buffer[1] = {HT16K33_ON};
+    display->display_is_on = false;
     i2c_module_send(HT16K33_ADDRESS, buffer, 1);    
 
     // seven_seg_display_on();
-    seven_seg_brightness(0xF);
+    seven_seg_brightness(display, 0xF);
+    return true;
 }
 
 
-bool seven_seg_reset(){
+bool seven_seg_reset(struct seven_seg* display){
+    (void)display;
     return true;
 }
 
 
-void seven_seg_display_on(){   
+void seven_seg_display_on(struct seven_seg* display){   
     uint8_t buffer[1] = {HT16K33_DISPLAYON};
-    i2c_module_send(HT16K33_ADDRESS, buffer, 1);
-    display_is_on = true;
+    // if it didn't get through, refresh() tries again next time
+    display->display_is_on = i2c_module_send(HT16K33_ADDRESS, buffer, 1) == 1;
 }
 
 
-void seven_seg_display_off(){
+void seven_seg_display_off(struct seven_seg* display){
     uint8_t buffer[1] = {HT16K33_DISPLAYOFF};
     i2c_module_send(HT16K33_ADDRESS, buffer, 1);
-    display_is_on = false;
+    display->display_is_on = false;
 }
 
 
-void seven_seg_brightness(uint8_t brightness){
-
+void seven_seg_brightness(struct seven_seg* display, uint8_t brightness){
+    (void)display;      // there's only the one ht16k33 address
     if (brightness > 0x0F) brightness = 0x0F;
-    int ret;
     uint8_t buffer[1] = {HT16K33_BRIGHTNESS | brightness};  //E0 for off, EF for max brightness
     i2c_module_send(HT16K33_ADDRESS, buffer, 1);
 }
 
 // testarray must be length 4
-void seven_seg_display_test(int* testarray){
+void seven_seg_display_test(struct seven_seg* display, int* testarray){
     
     //check for valid input. must be 4 numbers that each map to charmap
     for(int i=0; i<4; i++){
         if(testarray[i] >= CHARMAP_LENGTH || testarray[i] < 0) return;
     }
 
-    displaycache[0] = charmap[testarray[0]];
-    displaycache[1] = charmap[testarray[1]];
-    displaycache[2] = 0x00;
-    displaycache[3] = charmap[testarray[2]];
-    displaycache[4] = charmap[testarray[3]];
-    refresh();
+    display->displaycache[0] = charmap[testarray[0]];
+    display->displaycache[1] = charmap[testarray[1]];
+    display->displaycache[2] = 0x00;
+    display->displaycache[3] = charmap[testarray[2]];
+    display->displaycache[4] = charmap[testarray[3]];
+    refresh(display);
 
 }
 
 
 // arg temperature = temp * 10. IE 753 = 75.3 degrees
-void seven_seg_display_temp(int temperature){ 
+void seven_seg_display_temp(struct seven_seg* display, int temperature){ 
     
     //check for invalid numbers
     if(temperature > 999 || temperature < 300) return;
 
     // turn on the display if it isn't already
-    if(!display_is_on)
-        seven_seg_display_on();
+    if(!display->display_is_on)
+        seven_seg_display_on(display);
     
     // get each digit of temperature and assign it to its spot in displaycache
     uint8_t mask;
@@ -144,7 +137,7 @@ void seven_seg_display_temp(int temperature){
         
         // position 2 is the colon
         if(pos==2){
-            displaycache[pos] = 0x00;  
+            display->displaycache[pos] = 0x00;  
             continue;
         } 
 
@@ -158,16 +151,16 @@ void seven_seg_display_temp(int temperature){
         //right now I'm only using the rightmost 3 digits of the screen,
         //or one decimal place
         if(temperature > 0)
-            displaycache[pos] = mask;
+            display->displaycache[pos] = mask;
         else
-            displaycache[pos] = 0x00;
+            display->displaycache[pos] = 0x00;
 
         // truncate to get the next digit of temperature        
         temperature /= 10; 
 
     }
     
-    refresh();
+    refresh(display);
     
 }
 
@@ -175,17 +168,17 @@ void seven_seg_display_temp(int temperature){
 
 
 // arg humidity should just be 2 digits. An int from 1 to 99, no decimal
-void seven_seg_display_humidity(int humidity){ 
+void seven_seg_display_humidity(struct seven_seg* display, int humidity){ 
     
     //check for invalid numbers
     if(humidity > 99 || humidity < 1) return;
     
-    displaycache[0] = LETTER_H;
-    displaycache[1] = 0x00;
-    displaycache[2] = 0x00;
-    displaycache[3] = charmap[humidity / 10];
-    displaycache[4] = charmap[humidity % 10];
+    display->displaycache[0] = LETTER_H;
+    display->displaycache[1] = 0x00;
+    display->displaycache[2] = 0x00;
+    display->displaycache[3] = charmap[humidity / 10];
+    display->displaycache[4] = charmap[humidity % 10];
     
-    refresh();
+    refresh(display);
     
 }
\ No newline at end of file
@@ -3,25 +3,33 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 
+#define SEVEN_SEG_DIGITS 5
+
+// one per display
+struct seven_seg {
+    uint8_t displaycache[SEVEN_SEG_DIGITS];
+    bool display_is_on;
+};
 
 
 
 // WARNING: Call i2c start before calling this. I'll organize it better later
-bool seven_seg_begin();
+bool seven_seg_begin(struct seven_seg* display);
 
-bool seven_seg_reset();
+bool seven_seg_reset(struct seven_seg* display);
 
-void seven_seg_display_on();
+void seven_seg_display_on(struct seven_seg* display);
 
-void seven_seg_display_off();
+void seven_seg_display_off(struct seven_seg* display);
 
-void seven_seg_brightness(uint8_t brightness);
+void seven_seg_brightness(struct seven_seg* display, uint8_t brightness);
 
-void seven_seg_display_test(int* testarray);
+void seven_seg_display_test(struct seven_seg* display, int* testarray);
 
-void seven_seg_display_temp(int temperature);
+void seven_seg_display_temp(struct seven_seg* display, int temperature);
 
-void seven_seg_display_humidity(int humidity);
+void seven_seg_display_humidity(struct seven_seg* display, int humidity);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "telemetry.h"
+#include "net.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define FIELDS 5
+
+
+
+void telemetry_initialize(struct telemetry* t, uint32_t interval){
+    memset(t, 0, sizeof(*t));
+    t->interval = interval;
+}
+
+
+static void sample_fields(const struct telemetry_sample* s, long* fields){
+    fields[0] = s->time;
+    fields[1] = s->temperature;
+    fields[2] = s->humidity;
+    fields[3] = s->setting;
+    fields[4] = s->relay;
+}
+
+
+bool telemetry_add(struct telemetry* t, const struct telemetry_sample* sample){
+    long now[FIELDS];
+    sample_fields(sample, now);
+
+    if(t->count == 0){
+        t->length = snprintf(t->payload, TELEMETRY_PAYLOAD, "v1 %lu\n%ld,%ld,%ld,%ld,%ld\n",
+                             (unsigned long)t->interval, now[0], now[1], now[2], now[3], now[4]);
+    }
+    else {
+        long before[FIELDS];
+        sample_fields(&t->previous, before);
+        before[0] += t->interval;
+
+        // the last field that changed, so trailing commas can be left off
+        int last = -1;
+        for(int i=0; i<FIELDS; i++){
+            if(now[i] != before[i]) last = i;
+        }
+        char* p = t->payload + t->length;
+        for(int i=0; i<=last; i++){
+            if(i > 0) *p++ = ',';
+            if(now[i] != before[i]) p += sprintf(p, "%ld", now[i] - before[i]);
+        }
+        *p++ = '\n';
+        t->length = p - t->payload;
+    }
+
+    t->previous = *sample;
+    t->count++;
+    return t->count >= TELEMETRY_BATCH || t->length > TELEMETRY_PAYLOAD - TELEMETRY_LINE;
+}
+
+
+
+static void on_message(const char* topic, const uint8_t* payload, int length, void* context){
+    struct telemetry* t = context;
+    if(strcmp(topic, TELEMETRY_SETTING_TOPIC) != 0 || length == 0 || length > 8) return;
+
+    char text[9];
+    memcpy(text, payload, length);
+    text[length] = 0;
+    int setting = atoi(text);
+    if(setting >= TELEMETRY_MIN_SETTING && setting <= TELEMETRY_MAX_SETTING)
+        t->remote_setting = setting;
+}
+
+
+int telemetry_send(struct telemetry* t, const char* host, int port){
+    struct mqtt_client* c = &t->client;
+    c->client_id = TELEMETRY_CLIENT_ID;
+    c->on_message = on_message;
+    c->context = t;
+    t->remote_setting = 0;
+    t->wakes++;
+
+    bool ok = net_up(TELEMETRY_JOIN_TIMEOUT)
+           && mqtt_connect(c, host, port, TELEMETRY_TIMEOUT);
+    if(ok){
+        ok = mqtt_subscribe(c, TELEMETRY_SETTING_TOPIC, TELEMETRY_TIMEOUT);
+        if(ok) mqtt_poll(c, TELEMETRY_LINGER);
+
+        if(ok && t->count > 0)
+            ok = mqtt_publish(c, TELEMETRY_TOPIC, (const uint8_t*)t->payload, t->length, false);
+        // an empty retained message clears it, so it's only applied once
+        if(ok && t->remote_setting)
+            ok = mqtt_publish(c, TELEMETRY_SETTING_TOPIC, NULL, 0, true);
+        mqtt_disconnect(c);
+    }
+    net_down();
+
+    if(ok){
+        t->samples_sent += t->count;
+        t->bytes_sent += t->length;
+    }
+    else {
+        t->failures++;
+        t->samples_dropped += t->count;
+    }
+    t->count = 0;
+    t->length = 0;
+    return ok ? t->remote_setting : 0;
+}
+
+
+
+int telemetry_decode(const char* payload, int length, struct telemetry_sample* samples, int max){
+    const char* p = payload;
+    const char* end = payload + length;
+    unsigned long interval;
+    int n;
+
+    if(sscanf(p, "v1 %lu\n%n", &interval, &n) != 1) return -1;
+    p += n;
+
+    long value[FIELDS] = {0};
+    int count = 0;
+    while(p < end && count < max){
+        const char* line_end = memchr(p, '\n', end - p);
+        if(!line_end) line_end = end;
+
+        // each field is a change, except on the first line
+        long field[FIELDS] = {0};
+        for(int i=0; i<FIELDS && p < line_end; i++){
+            if(*p != ','){
+                char* after;
+                field[i] = strtol(p, &after, 10);
+                p = after;
+            }
+            if(p < line_end && *p == ',') p++;
+        }
+        if(count == 0){
+            for(int i=0; i<FIELDS; i++) value[i] = field[i];
+        }
+        else {
+            value[0] += interval;
+            for(int i=0; i<FIELDS; i++) value[i] += field[i];
+        }
+
+        samples[count].time = value[0];
+        samples[count].temperature = value[1];
+        samples[count].humidity = value[2];
+        samples[count].setting = value[3];
+        samples[count].relay = value[4];
+        count++;
+        p = line_end + 1;
+    }
+    return count;
+}
+
+
+
+void telemetry_print_stats(const struct telemetry* t){
+    printf("%lu wake ups, %lu failed, %lu samples sent in %lu bytes, %lu dropped, %d waiting\n",
+        (unsigned long)t->wakes, (unsigned long)t->failures, (unsigned long)t->samples_sent,
+        (unsigned long)t->bytes_sent, (unsigned long)t->samples_dropped, t->count);
+}
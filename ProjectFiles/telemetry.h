@@ -0,0 +1,85 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "mqtt.h"
+
+
+// Batches up readings and sends them over MQTT every so often, so the
+// radio is only on for a moment every few minutes. Each wake up it joins
+// the network, connects, picks up any setting sent from outside, publishes
+// the batch and turns the radio off again.
+//
+// A batch is text, one sample per line, delta encoded:
+//
+//   v1 <sample interval s>
+//   <time s>,<temperature>,<humidity>,<setting>,<relay>
+//   <time - interval>,<change in temperature>,...
+//
+// Only the first sample is absolute. After that a field is the change
+// from the sample before, with 0 left empty and trailing commas dropped,
+// so a sample where nothing changed is an empty line. Temperatures are in
+// 10ths of a degree, as everywhere else.
+//
+// To change the setting remotely, publish it (in 10ths) retained to
+// TELEMETRY_SETTING_TOPIC. It's picked up on the next wake up and the
+// retained message is cleared.
+
+#define TELEMETRY_BATCH 30                  // samples. 5 minutes at SENSE_INTERVAL
+#define TELEMETRY_PAYLOAD 512
+#define TELEMETRY_LINE 64                   // longest a sample line can be
+#define TELEMETRY_CLIENT_ID "thermostat"
+#define TELEMETRY_TOPIC "thermostat/telemetry"
+#define TELEMETRY_SETTING_TOPIC "thermostat/setting/set"
+#define TELEMETRY_JOIN_TIMEOUT 10000        // ms
+#define TELEMETRY_TIMEOUT 2000
+#define TELEMETRY_LINGER 200                // wait for retained messages after subscribing
+#define TELEMETRY_MIN_SETTING 400
+#define TELEMETRY_MAX_SETTING 900
+
+struct telemetry_sample {
+    uint32_t time;          // seconds
+    int temperature;
+    int humidity;
+    int setting;
+    int relay;
+};
+
+struct telemetry {
+    uint32_t interval;      // seconds between samples
+    struct telemetry_sample previous;
+    char payload[TELEMETRY_PAYLOAD];
+    int length;
+    int count;
+    int remote_setting;     // 0 if none came
+
+    struct mqtt_client client;
+
+    // for the console
+    uint32_t wakes;
+    uint32_t failures;
+    uint32_t samples_sent;
+    uint32_t samples_dropped;
+    uint32_t bytes_sent;
+};
+
+
+void telemetry_initialize(struct telemetry* t, uint32_t interval);
+
+// returns true when the batch is full and should be sent
+bool telemetry_add(struct telemetry* t, const struct telemetry_sample* sample);
+
+// radio on, publish, radio off. The batch is started again whether it got
+// through or not. Returns a setting sent from outside, or 0
+int telemetry_send(struct telemetry* t, const char* host, int port);
+
+// turns a batch back into samples. Returns how many, or -1 if it's not a
+// batch
+int telemetry_decode(const char* payload, int length, struct telemetry_sample* samples, int max);
+
+// console command
+void telemetry_print_stats(const struct telemetry* t);
+
+
+#endif
@@ -0,0 +1,69 @@
+#include "thermostat.h"
+
+
+
+void thermostat_initialize(struct thermostat* t, int setting){
+    t->ui_state = UI_TEMP;
+    t->temperature_setting = setting;
+    t->current_temperature = THERMOSTAT_NO_READING;
+    t->current_humidity = 99;
+    t->threshold = TEMP_THRESHOLD;
+    t->relay_state = OFF;
+
+    t->sensor.initialized = false;
+    t->sensor.mux_channel = AHT20_NO_MUX;
+    t->sensor.mux_present = false;
+    t->display.display_is_on = false;
+    optimal_start_initialize(&t->model);
+
+    buffer_initialize(&t->samples, t->temperature_setting+20); //+20 so the relay doesn't turn on at first
+}
+
+
+
+void thermostat_new_reading(struct thermostat* t){
+    // retrieve measurements from module
+    int temp_reading = aht20_get_temp(&t->sensor);
+    t->current_humidity = aht20_get_humidity(&t->sensor);
+
+    buffer_append(&t->samples, temp_reading);
+    t->current_temperature = buffer_get_avg(&t->samples);
+}
+
+
+
+// checks if the temperature setting is above or below the actual temperature
+// and sets the relay accordingly
+int thermostat_update_relay(struct thermostat* t){
+    if (t->relay_state == OFF){
+        if(t->current_temperature < (t->temperature_setting)){
+            t->relay_state = ON;
+        }
+    }
+    else {
+        if (t->current_temperature > (t->temperature_setting + t->threshold)){
+            t->relay_state = OFF;
+        }
+    }
+    return t->relay_state;
+}
+
+
+
+void thermostat_set_setting(struct thermostat* t, int setting){
+    t->temperature_setting = setting;
+}
+
+
+
+int thermostat_get_temperature(struct thermostat* t){
+    return t->current_temperature;
+}
+
+int thermostat_get_humidity(struct thermostat* t){
+    return t->current_humidity;
+}
+
+int thermostat_get_setting(struct thermostat* t){
+    return t->temperature_setting;
+}
@@ -0,0 +1,66 @@
+#ifndef THERMOSTAT_H
+#define THERMOSTAT_H
+
+#include <stdbool.h>
+#include "aht20.h"
+#include "circular_buffer.h"
+#include "seven_seg.h"
+#include "ui.h"
+#include "optimal_start.h"
+
+#define ON 1
+#define OFF 0
+
+#define TEMP_THRESHOLD 15 // 1.5 degrees
+#define SET_TEMP_TIMEOUT_TIME 2000
+#define SENSE_INTERVAL 10000
+#define RELAY_INTERVAL 1000
+// the temperature until the first reading. Hot enough that the relay stays
+// off, and outside AHT20_VALID_TEMPERATURE
+#define THERMOSTAT_NO_READING 1999
+
+
+// The control logic lives here, with no FreeRTOS or pico calls, so the
+// same code can be run on the pico and on a PC. main.c owns the tasks and
+// timers and calls into these. The buttons and display are handled by ui.c.
+// Everything for one thermostat is in struct thermostat, so a PC
+// simulation can run lots of them at once.
+
+struct thermostat {
+    volatile int temperature_setting;
+    volatile int current_temperature;
+    volatile int current_humidity;
+    int threshold;      // relay turns off this far above the setting
+
+    enum ui_state ui_state;
+    int relay_state;
+
+    struct circular_buffer samples;
+    struct aht20 sensor;
+    struct seven_seg display;
+    struct heating_model model;
+};
+
+
+// doesn't touch the i2c bus. Call aht20_initialize and seven_seg_begin
+// on t->sensor and t->display when the hardware is ready
+void thermostat_initialize(struct thermostat* t, int temperature_setting);
+
+// call after aht20_read_measurement(). Averages the new reading in.
+// Send the ui a UI_EVENT_SAMPLE afterwards to update the display
+void thermostat_new_reading(struct thermostat* t);
+
+// returns the new relay state (ON or OFF)
+int thermostat_update_relay(struct thermostat* t);
+
+// change the setting without going through the buttons
+void thermostat_set_setting(struct thermostat* t, int temperature_setting);
+
+int thermostat_get_temperature(struct thermostat* t);
+
+int thermostat_get_humidity(struct thermostat* t);
+
+int thermostat_get_setting(struct thermostat* t);
+
+
+#endif
@@ -0,0 +1,102 @@
+#include "trace.h"
+
+#if configUSE_TRACE_RECORDER
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+
+
+static struct trace_record buffer[TRACE_BUFFER_SIZE];
+static uint32_t next_record = 0;     // total ever written, wraps into buffer
+static volatile bool paused = false;
+
+static char task_names[TRACE_MAX_TASKS][configMAX_TASK_NAME_LEN];
+static uint8_t current_task = 0;
+
+
+
+// called from inside the kernel, including during a context switch, and from
+// tasks, so it has to be short and can't block
+static void record(uint8_t type, uint8_t id, uint16_t arg){
+    if(paused) return;
+
+    uint32_t interrupts = save_and_disable_interrupts();
+    struct trace_record* r = &buffer[next_record & (TRACE_BUFFER_SIZE - 1)];
+    r->time = time_us_32();
+    r->type = type;
+    r->id = id;
+    r->arg = arg;
+    next_record++;
+    restore_interrupts(interrupts);
+}
+
+
+
+/*****************************************************/
+/****************** FreeRTOS hooks *******************/
+/*****************************************************/
+
+void trace_task_create(uint32_t task, const char* name){
+    if(task < TRACE_MAX_TASKS){
+        strncpy(task_names[task], name, configMAX_TASK_NAME_LEN - 1);
+    }
+    record(TRACE_TASK_CREATE, task, 0);
+}
+
+void trace_task_switched_in(uint32_t task){
+    current_task = task;
+    record(TRACE_TASK_IN, task, 0);
+}
+
+void trace_task_switched_out(uint32_t task){
+    record(TRACE_TASK_OUT, task, 0);
+}
+
+void trace_task_delay(void){
+    record(TRACE_TASK_DELAY, current_task, 0);
+}
+
+void trace_blocking_on_queue(int sending){
+    record(sending ? TRACE_QUEUE_SEND : TRACE_QUEUE_RECEIVE, current_task, 0);
+}
+
+
+
+/*****************************************************/
+/****************** I2C hooks ************************/
+/*****************************************************/
+
+void trace_i2c_start(int addr, int length, bool read){
+    record(TRACE_I2C_START, addr, (length & 0x7FFF) | (read ? TRACE_I2C_READ : 0));
+}
+
+void trace_i2c_end(int addr, int result){
+    record(TRACE_I2C_END, addr, (uint16_t)(int16_t)result);
+}
+
+
+
+void trace_dump(){
+    paused = true;
+
+    uint32_t total = next_record;
+    uint32_t count = total < TRACE_BUFFER_SIZE ? total : TRACE_BUFFER_SIZE;
+
+    printf("$trace begin %lu %lu\n", (unsigned long)count, (unsigned long)(total - count));
+    for(int i=0; i<TRACE_MAX_TASKS; i++){
+        if(task_names[i][0])
+            printf("$task %d %s\n", i, task_names[i]);
+    }
+    for(uint32_t i=total-count; i!=total; i++){
+        const struct trace_record* r = &buffer[i & (TRACE_BUFFER_SIZE - 1)];
+        printf("$r %08lx %02x %02x %04x\n", (unsigned long)r->time, r->type, r->id, r->arg);
+    }
+    printf("$trace end\n");
+
+    paused = false;
+}
+
+#endif
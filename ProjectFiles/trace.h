@@ -0,0 +1,68 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include <FreeRTOS.h>
+
+
+// Low overhead trace of task switches, blocking and i2c transactions.
+// Records go into a RAM ring buffer (the oldest get overwritten) and can be
+// dumped over usb serial with the "trace" console command. Host/trace2perfetto
+// turns a dump into a trace for chrome://tracing or ui.perfetto.dev.
+//
+// The FreeRTOS hooks are set up in FreeRTOSConfig.h.
+//
+// Dump format, one line each:
+//   $trace begin <records> <overwritten>
+//   $task <number> <name>
+//   $r <time us, hex> <type, hex> <id, hex> <arg, hex>
+//   $trace end
+
+#define TRACE_BUFFER_SIZE 1024   // records, must be a power of 2
+#define TRACE_MAX_TASKS 16
+
+// record types
+#define TRACE_TASK_CREATE       0x01    // id = task number
+#define TRACE_TASK_IN           0x02    // id = task number
+#define TRACE_TASK_OUT          0x03    // id = task number
+#define TRACE_TASK_DELAY        0x04    // id = task number
+#define TRACE_QUEUE_RECEIVE     0x05    // blocked on a queue. id = task number
+#define TRACE_QUEUE_SEND        0x06    // blocked on a full queue. id = task number
+#define TRACE_I2C_START         0x10    // id = address, arg = length, top bit set for reads
+#define TRACE_I2C_END           0x11    // id = address, arg = result (bytes, or negative error)
+
+#define TRACE_I2C_READ 0x8000
+
+struct trace_record {
+    uint32_t time;      // microseconds since boot, wraps every ~71 minutes
+    uint8_t type;
+    uint8_t id;
+    uint16_t arg;
+};
+
+
+#if configUSE_TRACE_RECORDER
+
+void trace_task_create(uint32_t task, const char* name);
+void trace_task_switched_in(uint32_t task);
+void trace_task_switched_out(uint32_t task);
+void trace_task_delay(void);
+void trace_blocking_on_queue(int sending);
+
+void trace_i2c_start(int addr, int length, bool read);
+void trace_i2c_end(int addr, int result);
+
+// prints the buffer over usb serial. Recording is paused while it's printing
+void trace_dump();
+
+#else
+
+static inline void trace_i2c_start(int addr, int length, bool read){}
+static inline void trace_i2c_end(int addr, int result){}
+static inline void trace_dump(){}
+
+#endif
+
+
+#endif
@@ -0,0 +1,131 @@
+#include "ui.h"
+#include "thermostat.h"
+
+
+
+enum ui_action {
+    ACTION_NONE,
+    ACTION_SHOW_SETTING,    // first press just shows the setting
+    ACTION_RAISE,           // later presses change it
+    ACTION_LOWER,
+    ACTION_SHOW_TEMP,
+    ACTION_SHOW_HUMIDITY,
+    ACTION_SHOW_OFF,
+};
+
+struct transition {
+    enum ui_state next;
+    enum ui_action action;
+    bool start_timeout;
+};
+
+
+static const struct transition transitions[UI_STATE_COUNT][UI_EVENT_COUNT] = {
+    [UI_TEMP] = {
+        [UI_EVENT_UP]       = {UI_SETTING_TEMP,  ACTION_SHOW_SETTING,  true},
+        [UI_EVENT_DOWN]     = {UI_SETTING_TEMP,  ACTION_SHOW_SETTING,  true},
+        [UI_EVENT_CYCLE]    = {UI_HUMID,         ACTION_SHOW_HUMIDITY, false},
+        [UI_EVENT_TIMEOUT]  = {UI_TEMP,          ACTION_SHOW_TEMP,     false},
+        [UI_EVENT_SAMPLE]   = {UI_TEMP,          ACTION_SHOW_TEMP,     false},
+    },
+    [UI_HUMID] = {
+        [UI_EVENT_UP]       = {UI_SETTING_HUMID, ACTION_SHOW_SETTING,  true},
+        [UI_EVENT_DOWN]     = {UI_SETTING_HUMID, ACTION_SHOW_SETTING,  true},
+        [UI_EVENT_CYCLE]    = {UI_OFF,           ACTION_SHOW_OFF,      false},
+        [UI_EVENT_TIMEOUT]  = {UI_HUMID,         ACTION_SHOW_HUMIDITY, false},
+        [UI_EVENT_SAMPLE]   = {UI_HUMID,         ACTION_SHOW_HUMIDITY, false},
+    },
+    [UI_OFF] = {
+        [UI_EVENT_UP]       = {UI_SETTING_OFF,   ACTION_SHOW_SETTING,  true},
+        [UI_EVENT_DOWN]     = {UI_SETTING_OFF,   ACTION_SHOW_SETTING,  true},
+        [UI_EVENT_CYCLE]    = {UI_TEMP,          ACTION_SHOW_TEMP,     false},
+        [UI_EVENT_TIMEOUT]  = {UI_OFF,           ACTION_SHOW_OFF,      false},
+        [UI_EVENT_SAMPLE]   = {UI_OFF,           ACTION_NONE,          false},
+    },
+    // while the setting is showing, new samples don't change the screen
+    [UI_SETTING_TEMP] = {
+        [UI_EVENT_UP]       = {UI_SETTING_TEMP,  ACTION_RAISE,         true},
+        [UI_EVENT_DOWN]     = {UI_SETTING_TEMP,  ACTION_LOWER,         true},
+        [UI_EVENT_CYCLE]    = {UI_SETTING_HUMID, ACTION_SHOW_HUMIDITY, false},
+        [UI_EVENT_TIMEOUT]  = {UI_TEMP,          ACTION_SHOW_TEMP,     false},
+        [UI_EVENT_SAMPLE]   = {UI_SETTING_TEMP,  ACTION_NONE,          false},
+    },
+    [UI_SETTING_HUMID] = {
+        [UI_EVENT_UP]       = {UI_SETTING_HUMID, ACTION_RAISE,         true},
+        [UI_EVENT_DOWN]     = {UI_SETTING_HUMID, ACTION_LOWER,         true},
+        [UI_EVENT_CYCLE]    = {UI_SETTING_OFF,   ACTION_SHOW_OFF,      false},
+        [UI_EVENT_TIMEOUT]  = {UI_HUMID,         ACTION_SHOW_HUMIDITY, false},
+        [UI_EVENT_SAMPLE]   = {UI_SETTING_HUMID, ACTION_NONE,          false},
+    },
+    [UI_SETTING_OFF] = {
+        [UI_EVENT_UP]       = {UI_SETTING_OFF,   ACTION_RAISE,         true},
+        [UI_EVENT_DOWN]     = {UI_SETTING_OFF,   ACTION_LOWER,         true},
+        [UI_EVENT_CYCLE]    = {UI_SETTING_TEMP,  ACTION_SHOW_TEMP,     false},
+        [UI_EVENT_TIMEOUT]  = {UI_OFF,           ACTION_SHOW_OFF,      false},
+        [UI_EVENT_SAMPLE]   = {UI_SETTING_OFF,   ACTION_NONE,          false},
+    },
+};
+
+
+
+bool ui_handle_event(struct thermostat* t, const struct ui_message* message,
+                     struct display_request* request){
+
+    const struct transition* transition = &transitions[t->ui_state][message->event];
+    t->ui_state = transition->next;
+
+    request->kind = DISPLAY_NOTHING;
+    request->value = 0;
+    request->event_time = message->time;
+    request->from_button = message->event == UI_EVENT_UP
+                        || message->event == UI_EVENT_DOWN
+                        || message->event == UI_EVENT_CYCLE;
+
+    switch(transition->action){
+    case ACTION_RAISE:
+        t->temperature_setting += SETTING_STEP;
+        // fall through
+    case ACTION_SHOW_SETTING:
+        request->kind = DISPLAY_TEMP;
+        request->value = t->temperature_setting;
+        break;
+    case ACTION_LOWER:
+        t->temperature_setting -= SETTING_STEP;
+        request->kind = DISPLAY_TEMP;
+        request->value = t->temperature_setting;
+        break;
+    case ACTION_SHOW_TEMP:
+        request->kind = DISPLAY_TEMP;
+        request->value = t->current_temperature;
+        break;
+    case ACTION_SHOW_HUMIDITY:
+        request->kind = DISPLAY_HUMIDITY;
+        request->value = t->current_humidity;
+        break;
+    case ACTION_SHOW_OFF:
+        request->kind = DISPLAY_OFF;
+        break;
+    case ACTION_NONE:
+        break;
+    }
+
+    return transition->start_timeout;
+}
+
+
+
+void ui_show(struct seven_seg* display, const struct display_request* request){
+    switch(request->kind){
+    case DISPLAY_TEMP:
+        seven_seg_display_temp(display, request->value);
+        break;
+    case DISPLAY_HUMIDITY:
+        seven_seg_display_humidity(display, request->value);
+        break;
+    case DISPLAY_OFF:
+        seven_seg_display_off(display);
+        break;
+    case DISPLAY_NOTHING:
+        break;
+    }
+}
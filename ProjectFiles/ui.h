@@ -0,0 +1,72 @@
+#ifndef UI_H
+#define UI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "seven_seg.h"
+
+
+// Table driven state machine for the buttons and display. Everything that
+// can change what's on the screen comes in as an event; the ui task in
+// main.c handles them one at a time, so nothing else touches the ui state.
+// Instead of writing to the display itself, it hands back a
+// display_request for the display task to draw.
+
+#define SETTING_STEP 10     // 1 degree per button press
+
+enum ui_event {
+    UI_EVENT_UP,
+    UI_EVENT_DOWN,
+    UI_EVENT_CYCLE,
+    UI_EVENT_TIMEOUT,       // screen timeout after a button press
+    UI_EVENT_SAMPLE,        // new temperature/humidity reading
+    UI_EVENT_COUNT,
+};
+
+// what the cycle button picked, and whether the setting is being shown
+// over the top of it
+enum ui_state {
+    UI_TEMP,
+    UI_HUMID,
+    UI_OFF,
+    UI_SETTING_TEMP,
+    UI_SETTING_HUMID,
+    UI_SETTING_OFF,
+    UI_STATE_COUNT,
+};
+
+enum display_kind {
+    DISPLAY_NOTHING,
+    DISPLAY_TEMP,
+    DISPLAY_HUMIDITY,
+    DISPLAY_OFF,
+};
+
+// what gets sent to the ui task
+struct ui_message {
+    enum ui_event event;
+    uint32_t time;          // us since boot when it happened
+};
+
+// what gets sent to the display task
+struct display_request {
+    enum display_kind kind;
+    int value;
+    uint32_t event_time;    // time of the event that caused it
+    bool from_button;       // for measuring button to display latency
+};
+
+
+struct thermostat;
+
+// runs one event through the state table. Fills in request (kind is
+// DISPLAY_NOTHING if the screen doesn't need to change). Returns true if
+// the screen timeout should be (re)started
+bool ui_handle_event(struct thermostat* t, const struct ui_message* message,
+                     struct display_request* request);
+
+// does the actual i2c writes for a request
+void ui_show(struct seven_seg* display, const struct display_request* request);
+
+
+#endif
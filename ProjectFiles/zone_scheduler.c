@@ -0,0 +1,77 @@
+#include "zone_scheduler.h"
+
+
+
+void zone_scheduler_initialize(struct zone_scheduler* s, struct zone* zones, int* queue,
+                               int count, uint32_t stagger_time){
+    s->zones = zones;
+    s->count = count;
+    s->queue = queue;
+    s->queue_head = 0;
+    s->queue_length = 0;
+    s->stagger_time = stagger_time;
+    s->last_switch_on = 0;
+    s->switched_on_yet = false;
+
+    for(int i=0; i<count; i++){
+        zones[i].output = OFF;
+        zones[i].waiting = false;
+    }
+}
+
+
+static void enqueue(struct zone_scheduler* s, int zone){
+    int tail = s->queue_head + s->queue_length;
+    if(tail >= s->count) tail -= s->count;
+    s->queue[tail] = zone;
+    s->queue_length++;
+}
+
+static int dequeue(struct zone_scheduler* s){
+    int zone = s->queue[s->queue_head];
+    s->queue_head++;
+    if(s->queue_head == s->count) s->queue_head = 0;
+    s->queue_length--;
+    return zone;
+}
+
+
+
+int zone_scheduler_tick(struct zone_scheduler* s, uint32_t now){
+    int changed = 0;
+
+    // evaluate every zone. Each one is in the queue at most once, so it
+    // never holds more than count
+    for(int i=0; i<s->count; i++){
+        struct zone* z = &s->zones[i];
+        int wanted = thermostat_update_relay(&z->thermostat);
+
+        if(wanted == OFF && z->output == ON){
+            z->output = OFF;
+            changed++;
+        }
+        else if(wanted == ON && z->output == OFF && !z->waiting){
+            z->waiting = true;
+            enqueue(s, i);
+        }
+    }
+
+    if(s->switched_on_yet && now - s->last_switch_on < s->stagger_time)
+        return changed;
+
+    // switch on the zone that has waited longest. Zones that stopped
+    // wanting heat while they waited are dropped on the way - each was
+    // queued once, so this is still constant per zone overall
+    while(s->queue_length > 0){
+        struct zone* z = &s->zones[dequeue(s)];
+        z->waiting = false;
+        if(z->thermostat.relay_state == ON && z->output == OFF){
+            z->output = ON;
+            s->last_switch_on = now;
+            s->switched_on_yet = true;
+            changed++;
+            break;
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,48 @@
+#ifndef ZONE_SCHEDULER_H
+#define ZONE_SCHEDULER_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "thermostat.h"
+
+
+// Runs several zones, each with its own sensor, setting and relay. Every
+// tick all the zones are evaluated together. Relays switch off straight
+// away, but switching on is staggered: zones wait their turn in a queue
+// and only one relay turns on per stagger time, so the heaters' inrush
+// currents don't all land at once.
+//
+// A tick costs the same for each zone no matter how many there are.
+
+#define ZONE_STAGGER_TIME 2000
+
+
+struct zone {
+    struct thermostat thermostat;
+    bool output;        // what the relay is actually doing
+    bool waiting;       // in the queue to switch on
+};
+
+struct zone_scheduler {
+    struct zone* zones;
+    int count;
+    int* queue;         // zones waiting to switch on, oldest first
+    int queue_head;
+    int queue_length;
+    uint32_t stagger_time;
+    uint32_t last_switch_on;
+    bool switched_on_yet;
+};
+
+
+// queue needs room for count ints. The zones' thermostats should already
+// be initialized
+void zone_scheduler_initialize(struct zone_scheduler* s, struct zone* zones, int* queue,
+                               int count, uint32_t stagger_time);
+
+// now is in ms. Returns how many relays changed; look at each zone's output
+// for the new states
+int zone_scheduler_tick(struct zone_scheduler* s, uint32_t now);
+
+
+#endif